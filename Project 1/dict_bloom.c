@@ -0,0 +1,148 @@
+// dict_bloom.c: optional blocked Bloom filter in front of dict_find(),
+// switched on with dict_set_bloom(). Each word sets one bit in each of the
+// 8 words of a single 64-byte block picked by its hash, so adding or
+// testing a word touches one cache line. A word that misses any of its 8
+// bits is certainly not in the dictionary and is rejected without
+// searching the backend; a word that hits all of them is searched as usual.
+
+#include <stdlib.h>
+#include <string.h>
+#include "dictionary.h"
+
+#define BLOOM_MIN_CAPACITY 1024 // fewest words a filter is sized for
+
+// Odd constants giving each word of a block its own bit for the same hash
+static const unsigned bloom_salt[BLOOM_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/* Bloom hash mixes the hash of the length characters of word so every bit of it depends on
+    every character, since the filter uses the high and low halves separately.
+*/
+unsigned long bloom_hash(const char *word, unsigned length){
+    unsigned long hash = hash_span(word, length);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdUL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53UL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/* Bloom block returns the block of the filter of dict that a word with the given hash uses. The
+    high half of the hash is scaled to the number of blocks, which need not be a power of two.
+*/
+bloom_block_t *bloom_block(const dictionary_t *dict, unsigned long hash){
+    return &dict->bloom[((hash >> 32) * dict->bloom_blocks) >> 32];
+}
+
+/* Bloom bit returns the bit for word i of a block for a word with the given hash.
+*/
+unsigned long bloom_bit(unsigned long hash, int i){
+    return 1UL << (((unsigned) hash * bloom_salt[i]) >> 26);
+}
+
+/* Bloom set sets the bits of the word with the given hash in the filter of dict.
+*/
+void bloom_set(dictionary_t *dict, unsigned long hash){
+    bloom_block_t *block = bloom_block(dict, hash);
+    for(int i = 0; i < BLOOM_BLOCK_WORDS; i++){
+        block->bits[i] |= bloom_bit(hash, i);
+    }
+}
+
+/* Bloom build replaces the filter of dict with a new one sized for capacity words, at
+    dict->bloom_bits bits each, and sets the bits of every word in its string arena, or in the string
+    table of a mapped dictionary. Every tree or hash word is in the arena, along with perhaps a few
+    repeats, which setting twice doesn't change. If memory can't be allocated the dictionary is left
+    with no filter, which is always safe.
+*/
+void bloom_build(dictionary_t *dict, unsigned long capacity){
+    free(dict->bloom);
+    dict->bloom = NULL;
+    dict->bloom_blocks = 0;
+    dict->bloom_capacity = 0;
+
+    if(capacity < BLOOM_MIN_CAPACITY){
+        capacity = BLOOM_MIN_CAPACITY;
+    }
+    unsigned long bits = capacity * dict->bloom_bits;
+    unsigned long blocks = (bits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+    if(blocks > 0xFFFFFFFFUL){
+        return;
+    }
+    bloom_block_t *bloom = calloc(blocks, sizeof(bloom_block_t));
+    if(bloom == NULL){
+        return;
+    }
+    dict->bloom = bloom;
+    dict->bloom_blocks = blocks;
+    dict->bloom_capacity = capacity > 0xFFFFFFFFUL ? 0xFFFFFFFFU : capacity;
+
+    const char *word = dict->arena.chars;
+    const char *end = word + dict->arena.used;
+    if(dict->backend == DICT_BACKEND_MAPPED){
+        word = dict->map + mapped_header(dict)->strings;
+        end = word + mapped_header(dict)->strings_bytes;
+    }
+    while(word < end){
+        unsigned length = strlen(word);
+        bloom_set(dict, bloom_hash(word, length));
+        word += length + 1;
+    }
+}
+
+/* Bloom add records a word just added to dict in its filter, if the dictionary has one switched on.
+    The first word builds the filter, as does outgrowing it. Filters built here are sized for twice
+    the current words so one is rebuilt each time the dictionary doubles, and adding words stays O(1)
+    on average.
+*/
+void bloom_add(dictionary_t *dict, const char *word, unsigned length){
+    if(dict->bloom_bits == 0){
+        return;
+    }
+    if(dict->bloom == NULL || dict->size > dict->bloom_capacity){
+        bloom_build(dict, dict->size * 2UL);
+        return;
+    }
+    bloom_set(dict, bloom_hash(word, length));
+}
+
+/* Bloom may contain returns 0 if the filter of dict shows the length characters of query are not in
+    the dictionary and 1 if they may be. A dictionary with no filter may contain anything.
+*/
+int bloom_may_contain(const dictionary_t *dict, const char *query, unsigned length){
+    if(dict->bloom == NULL){
+        return 1;
+    }
+    unsigned long hash = bloom_hash(query, length);
+    const bloom_block_t *block = bloom_block(dict, hash);
+    unsigned long missing = 0;
+    for(int i = 0; i < BLOOM_BLOCK_WORDS; i++){
+        missing |= bloom_bit(hash, i) & ~block->bits[i];
+    }
+    return missing == 0;
+}
+
+/* Bloom false positive rate estimates the chance that a word not in the dictionary passes the filter
+    of dict. A word passes if all 8 of its bits are set, so for a block that chance is the product of
+    the fraction of bits set in each of its words, and a random word is equally likely to use any
+    block. Also stores the fraction of all bits that are set in fill.
+*/
+double bloom_false_positive_rate(const dictionary_t *dict, double *fill){
+    unsigned long set = 0;
+    double rate = 0;
+    for(unsigned b = 0; b < dict->bloom_blocks; b++){
+        double pass = 1;
+        for(int i = 0; i < BLOOM_BLOCK_WORDS; i++){
+            int count = __builtin_popcountl(dict->bloom[b].bits[i]);
+            set += count;
+            pass *= count / 64.0;
+        }
+        rate += pass;
+    }
+    unsigned long bits = dict->bloom_blocks * (unsigned long) BLOOM_BLOCK_BITS;
+    *fill = bits > 0 ? (double) set / bits : 0;
+    return dict->bloom_blocks > 0 ? rate / dict->bloom_blocks : 0;
+}
@@ -0,0 +1,157 @@
+// dict_frozen.c: frozen dictionaries, made with dict_freeze() once no more
+// words will be added. The words are laid out as an array in Eytzinger
+// order, the order a breadth-first walk of a perfectly balanced tree visits
+// them: the root at index 1 and the children of index k at 2k and 2k+1.
+// A search reads one entry per level with no pointers to chase, the first
+// levels share a few cache lines that stay hot, and the entries of the
+// next levels down sit together so they can be prefetched ahead.
+
+#include <stdlib.h>
+#include <string.h>
+#include "dictionary.h"
+
+// Entries ahead of index k fetched while comparing at k: the entries at
+// 16k to 16k+15 are its descendants four levels down, one cache line of them
+#define FROZEN_PREFETCH 16
+
+/* Frozen prefix packs the first 8 of the length characters of word, padded with zeros past the end,
+    into an unsigned long with the first byte highest, so comparing prefixes as numbers orders words
+    like strcmp on their first 8 bytes.
+*/
+unsigned long frozen_prefix(const char *word, unsigned length){
+    unsigned long prefix = 0;
+    unsigned i = 0;
+    for(; i < 8 && i < length; i++){
+        prefix = (prefix << 8) | (unsigned char) word[i];
+    }
+    return i < 8 ? prefix << (8 * (8 - i)) : prefix;
+}
+
+/* Frozen compare compares the word of entry with the query of length characters whose prefix is
+    given, like strcmp. The prefixes settle almost every comparison; only words that agree in their
+    first 8 bytes compare the rest.
+*/
+int frozen_compare(const dictionary_t *dict, const frozen_entry_t *entry,
+                   const char *query, unsigned length, unsigned long prefix){
+    if(entry->prefix != prefix){
+        return entry->prefix < prefix ? -1 : 1;
+    }
+    unsigned shorter = entry->length < length ? entry->length : length;
+    if(shorter > 8){
+        int cmp = memcmp(DICT_WORD(dict, entry->offset) + 8, query + 8, shorter - 8);
+        if(cmp != 0){
+            return cmp;
+        }
+    }
+    return (entry->length > length) - (entry->length < length); // a prefix sorts first
+}
+
+/* Frozen fill stores the sorted words into the subtree of the Eytzinger array rooted at index k,
+    which holds count entries in all, by an in-order walk of its implicit tree. *next is the index of
+    the next word to store.
+*/
+void frozen_fill(dictionary_t *dict, frozen_entry_t *frozen, const char **words,
+                 unsigned *next, unsigned long k, unsigned count){
+    if(k > count){
+        return;
+    }
+    frozen_fill(dict, frozen, words, next, 2 * k, count);
+    const char *word = words[(*next)++];
+    unsigned length = strlen(word);
+    frozen[k].prefix = frozen_prefix(word, length);
+    frozen[k].offset = word - dict->arena.chars;
+    frozen[k].length = length;
+    frozen_fill(dict, frozen, words, next, 2 * k + 1, count);
+}
+
+/* Frozen collect stores pointers to the words of the subtree of the Eytzinger array rooted at index
+    k in ABC order into words, starting at index *count and advancing *count past them.
+*/
+void frozen_collect(const dictionary_t *dict, unsigned long k, const char **words, unsigned *count){
+    if(k > dict->size){
+        return;
+    }
+    frozen_collect(dict, 2 * k, words, count);
+    words[(*count)++] = DICT_WORD(dict, dict->frozen[k].offset);
+    frozen_collect(dict, 2 * k + 1, words, count);
+}
+
+/* Frozen sorted words returns a malloc'd array of the dict->size words of a frozen dictionary in
+    ABC order, or NULL if memory can't be allocated. The caller frees the array but not the words.
+*/
+const char **frozen_sorted_words(const dictionary_t *dict){
+    const char **words = malloc((dict->size > 0 ? dict->size : 1) * sizeof(char *));
+    if(words == NULL){
+        return NULL;
+    }
+    unsigned count = 0;
+    frozen_collect(dict, 1, words, &count);
+    return words;
+}
+
+int dict_freeze(dictionary_t *dict) {
+    if(dict->backend == DICT_BACKEND_FROZEN || dict->backend == DICT_BACKEND_MAPPED){
+        return 0; // already a read-only array
+    }
+    const char **words = dict->size > 0 ? dict_sorted_words(dict) : NULL;
+    frozen_entry_t *frozen = malloc((dict->size + 1UL) * sizeof(frozen_entry_t));
+    if((dict->size > 0 && words == NULL) || frozen == NULL){
+        free(words);
+        free(frozen);
+        return -1;
+    }
+    unsigned next = 0;
+    frozen_fill(dict, frozen, words, &next, 1, dict->size);
+    free(words);
+
+    // the words stay in the arena, everything else the old backend had goes
+    hash_free(dict);
+    while(dict->chunks != NULL){
+        node_chunk_t *chunk = dict->chunks;
+        dict->chunks = chunk->next;
+        free(chunk);
+    }
+    dict->root = NULL;
+    dict->frozen = frozen;
+    dict->backend = DICT_BACKEND_FROZEN;
+    return 0;
+}
+
+/* Frozen find searches a frozen dictionary for the query of length characters. Each step moves from
+    index k to 2k, or to 2k+1 if the entry at k sorts before the query, without a branch on the
+    outcome. Once past the end of the array, shifting off the trailing 1 bits and the 0 above them
+    undoes the final run of moves right and leaves the index of the first entry not before the query,
+    or 0 if there is none. Returns 1 if that entry is the query and 0 otherwise.
+*/
+int frozen_find(const dictionary_t *dict, const char *query, unsigned length){
+    const frozen_entry_t *frozen = dict->frozen;
+    unsigned long prefix = frozen_prefix(query, length);
+    unsigned long n = dict->size;
+    unsigned long k = 1;
+    while(k <= n){
+        __builtin_prefetch(frozen + (FROZEN_PREFETCH * k < n ? FROZEN_PREFETCH * k : 0));
+        k = 2 * k + (frozen_compare(dict, &frozen[k], query, length, prefix) < 0);
+    }
+    k >>= __builtin_ffsl(~k);
+    return k != 0 && frozen_compare(dict, &frozen[k], query, length, prefix) == 0;
+}
+
+/* Frozen thaw turns a frozen dictionary back into a tree dictionary holding the same words so it
+    can be changed, building a balanced tree from the words in order. Returns 0 on success or -1 if
+    memory can't be allocated, leaving the dictionary frozen.
+*/
+int frozen_thaw(dictionary_t *dict){
+    const char **words = frozen_sorted_words(dict);
+    if(words == NULL){
+        return -1;
+    }
+    int result = build_balanced(dict, (char **) words, dict->size, &dict->root);
+    free(words);
+    if(result != 0){
+        return -1;
+    }
+    free(dict->frozen);
+    dict->frozen = NULL;
+    dict->backend = DICT_BACKEND_TREE;
+    return 0;
+}
@@ -0,0 +1,165 @@
+// dict_hash.c: hash table backend for dictionary_t, selected with
+// dict_set_backend(DICT_BACKEND_HASH). Words live in a Robin Hood open
+// addressing table: each word sits as close to the slot its hash picks
+// as possible, and an insert that has probed further than the word in a
+// slot takes that slot and carries the other word on. Probe lengths stay
+// short and even, so a lookup costs one hash and usually one strcmp.
+
+#include <stdlib.h>
+#include <string.h>
+#include "dictionary.h"
+
+#define HASH_MIN_CAPACITY 64
+
+/* Hash span computes the 64-bit FNV-1a hash of the length characters starting at word.
+*/
+unsigned long hash_span(const char *word, unsigned length){
+    unsigned long hash = 14695981039346656037UL;
+    const unsigned char *c = (const unsigned char *) word;
+    for(unsigned i = 0; i < length; i++){
+        hash = (hash ^ c[i]) * 1099511628211UL;
+    }
+    return hash ^ (hash >> 32); // fold the well-mixed high bits into the slot bits
+}
+
+/* Probe distance returns how far the word in a slot sits from the slot its hash picks.
+*/
+unsigned probe_distance(const dictionary_t *dict, unsigned slot){
+    unsigned mask = dict->capacity - 1;
+    return (slot - (unsigned) (dict->slots[slot].hash & mask)) & mask;
+}
+
+/* Hash place puts an occupied slot entry into the table, which must have an empty slot,
+    displacing words closer to their home slots on the way as Robin Hood hashing does.
+*/
+void hash_place(dictionary_t *dict, hash_slot_t entry){
+    unsigned mask = dict->capacity - 1;
+    unsigned slot = entry.hash & mask;
+    unsigned dist = 0;
+    while(dict->slots[slot].word != 0){
+        unsigned existing = probe_distance(dict, slot);
+        if(existing < dist){
+            hash_slot_t evicted = dict->slots[slot];
+            dict->slots[slot] = entry;
+            entry = evicted;
+            dist = existing;
+        }
+        slot = (slot + 1) & mask;
+        dist++;
+    }
+    dict->slots[slot] = entry;
+}
+
+/* Hash grow doubles the number of slots, or allocates the first ones, and places every word
+    again. Returns 0 on success or -1 if memory can't be allocated.
+*/
+int hash_grow(dictionary_t *dict){
+    unsigned old_capacity = dict->capacity;
+    hash_slot_t *old_slots = dict->slots;
+    unsigned capacity = old_capacity > 0 ? old_capacity * 2 : HASH_MIN_CAPACITY;
+    hash_slot_t *slots = calloc(capacity, sizeof(hash_slot_t));
+    if(slots == NULL){
+        return -1;
+    }
+    dict->slots = slots;
+    dict->capacity = capacity;
+    for(unsigned i = 0; i < old_capacity; i++){
+        if(old_slots[i].word != 0){
+            hash_place(dict, old_slots[i]);
+        }
+    }
+    free(old_slots);
+    return 0;
+}
+
+/* Hash lookup returns the slot holding word, whose hash and length are given, or -1 if it is not
+    present. A probe stops at an empty slot or once it is further from home than the word it is
+    looking at, since Robin Hood placement would have put the word there.
+*/
+long hash_lookup(const dictionary_t *dict, const char *word, unsigned long hash, unsigned length){
+    if(dict->capacity == 0){
+        return -1;
+    }
+    unsigned mask = dict->capacity - 1;
+    unsigned slot = hash & mask;
+    for(unsigned dist = 0; dict->slots[slot].word != 0; dist++){
+        if(probe_distance(dict, slot) < dist){
+            return -1;
+        }
+        const hash_slot_t *entry = &dict->slots[slot];
+        if(entry->hash == hash && entry->length == length &&
+           memcmp(DICT_WORD(dict, entry->word - 1), word, length) == 0){
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+/* Hash insert adds a copy of word to the string arena and the table, growing the table to keep
+    it at most 7/8 full. Returns 0 if the word was added or already present or -1 if memory
+    can't be allocated.
+*/
+int hash_insert(dictionary_t *dict, const char *word){
+    unsigned length = strlen(word);
+    unsigned long hash = hash_span(word, length);
+    if(hash_lookup(dict, word, hash, length) >= 0){
+        return 0;
+    }
+    if((dict->size + 1) * 8UL > dict->capacity * 7UL && hash_grow(dict) != 0){
+        return -1;
+    }
+    long offset = arena_add(dict, word, length);
+    if(offset < 0){
+        return -1;
+    }
+    hash_slot_t entry = {hash, offset + 1, length};
+    hash_place(dict, entry);
+    dict->size = dict->size + 1;
+    bloom_add(dict, word, length);
+    return 0;
+}
+
+/* Hash find returns 1 if the query of length characters, which need not be null-terminated, is in
+    the table and 0 otherwise.
+*/
+int hash_find(const dictionary_t *dict, const char *query, unsigned length){
+    unsigned long hash = hash_span(query, length);
+    return hash_lookup(dict, query, hash, length) >= 0;
+}
+
+/* Compare words orders two entries of an array of strings for qsort.
+*/
+int compare_words(const void *a, const void *b){
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+/* Hash sorted words returns a malloc'd array of the dict->size words in the table in ABC
+    order, or NULL if it is empty or memory can't be allocated. The caller frees the array
+    but not the words, which point into the string arena.
+*/
+const char **hash_sorted_words(const dictionary_t *dict){
+    if(dict->size == 0){
+        return NULL;
+    }
+    const char **words = malloc(dict->size * sizeof(char *));
+    if(words == NULL){
+        return NULL;
+    }
+    unsigned count = 0;
+    for(unsigned i = 0; i < dict->capacity; i++){
+        if(dict->slots[i].word != 0){
+            words[count++] = DICT_WORD(dict, dict->slots[i].word - 1);
+        }
+    }
+    qsort(words, count, sizeof(char *), compare_words);
+    return words;
+}
+
+/* Hash free frees the table. The words belong to the string arena and are freed with it.
+*/
+void hash_free(dictionary_t *dict){
+    free(dict->slots);
+    dict->slots = NULL;
+    dict->capacity = 0;
+}
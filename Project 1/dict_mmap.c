@@ -0,0 +1,255 @@
+// dict_mmap.c: read-only binary dictionary files. write_dict_to_binary_file()
+// compiles a dictionary into a sorted index and string table, and
+// open_dict_mmap() maps such a file and searches it where it lies, so a
+// large dictionary is ready as soon as the mapping is, with no parsing and
+// only the pages a lookup touches read from disk.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dictionary.h"
+
+/* Word prefix packs the first 4 of the length characters of word, padded with zeros past the end,
+    into an unsigned int with the first byte highest. Comparing the prefixes of two words as numbers
+    gives the same order as strcmp on their first 4 bytes.
+*/
+unsigned word_prefix(const char *word, unsigned length){
+    unsigned prefix = 0;
+    unsigned i = 0;
+    for(; i < 4 && i < length; i++){
+        prefix = (prefix << 8) | (unsigned char) word[i];
+    }
+    return i < 4 ? prefix << (8 * (4 - i)) : prefix;
+}
+
+/* Span compare compares the null-terminated word with the length characters of span like strcmp
+    would if span were null-terminated, never reading word past its terminator.
+*/
+int span_compare(const char *word, const char *span, unsigned length){
+    for(unsigned i = 0; i < length; i++){
+        if(word[i] != span[i] || word[i] == '\0'){
+            return word[i] == '\0' ? -1 : (unsigned char) word[i] - (unsigned char) span[i];
+        }
+    }
+    return word[length] != '\0';
+}
+
+/* Dict sorted words returns a malloc'd array of the dict->size words of a tree, hash or frozen
+    dictionary in ABC order, or NULL if memory can't be allocated. The caller frees the array but not the
+    words.
+*/
+const char **dict_sorted_words(const dictionary_t *dict){
+    if(dict->backend == DICT_BACKEND_HASH){
+        return hash_sorted_words(dict);
+    }
+    if(dict->backend == DICT_BACKEND_FROZEN){
+        return frozen_sorted_words(dict);
+    }
+    const char **words = malloc((dict->size > 0 ? dict->size : 1) * sizeof(char *));
+    if(words == NULL){
+        return NULL;
+    }
+    unsigned count = 0;
+    inorder_words(dict, dict->root, words, &count);
+    return words;
+}
+
+/* Mapped header returns the header at the start of the mapping of a mapped dictionary.
+*/
+const dict_file_header_t *mapped_header(const dictionary_t *dict){
+    return (const dict_file_header_t *) dict->map;
+}
+
+/* Mapped entries returns the index entries of a mapped dictionary, which follow the header.
+*/
+const dict_file_entry_t *mapped_entries(const dictionary_t *dict){
+    return (const dict_file_entry_t *) (dict->map + sizeof(dict_file_header_t));
+}
+
+/* Mapped word returns word i of a mapped dictionary in ABC order.
+*/
+const char *mapped_word(const dictionary_t *dict, unsigned i){
+    return dict->map + mapped_header(dict)->strings + mapped_entries(dict)[i].offset;
+}
+
+int write_dict_to_binary_file(const dictionary_t *dict, const char *file_name) {
+    FILE *file_handle = fopen(file_name, "wb");
+    if(file_handle == NULL){
+        return 1;
+    }
+    if(dict->backend == DICT_BACKEND_MAPPED){
+        // already in the binary format, copy it as it is
+        int failed = fwrite(dict->map, 1, dict->map_bytes, file_handle) != dict->map_bytes;
+        return fclose(file_handle) != 0 || failed;
+    }
+
+    const char **words = dict->size > 0 ? dict_sorted_words(dict) : NULL;
+    if(dict->size > 0 && words == NULL){
+        fclose(file_handle);
+        return 1;
+    }
+    dict_file_header_t header;
+    memcpy(header.magic, DICT_MAGIC, DICT_MAGIC_LEN);
+    header.count = dict->size;
+    header.reserved = 0;
+    header.strings = sizeof(dict_file_header_t) + dict->size * sizeof(dict_file_entry_t);
+    header.strings_bytes = 0;
+    for(unsigned i = 0; i < dict->size; i++){
+        header.strings_bytes += strlen(words[i]) + 1;
+    }
+
+    int failed = fwrite(&header, sizeof(header), 1, file_handle) != 1;
+    unsigned long offset = 0;
+    for(unsigned i = 0; i < dict->size && !failed; i++){
+        unsigned length = strlen(words[i]);
+        dict_file_entry_t entry = {word_prefix(words[i], length), offset};
+        failed = fwrite(&entry, sizeof(entry), 1, file_handle) != 1;
+        offset += length + 1;
+    }
+    for(unsigned i = 0; i < dict->size && !failed; i++){
+        failed = fputs(words[i], file_handle) == EOF || fputc('\0', file_handle) == EOF;
+    }
+    free(words);
+    return fclose(file_handle) != 0 || failed;
+}
+
+dictionary_t *open_dict_mmap(const char *file_name) {
+    int fd = open(file_name, O_RDONLY);
+    if(fd < 0){
+        return NULL;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(dict_file_header_t)){
+        close(fd);
+        return NULL;
+    }
+    const char *map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping stays valid without the descriptor
+    if(map == MAP_FAILED){
+        return NULL;
+    }
+
+    // check the header describes a file of this size rather than trusting it
+    const dict_file_header_t *header = (const dict_file_header_t *) map;
+    unsigned long bytes = info.st_size;
+    unsigned long index_end = sizeof(dict_file_header_t) + header->count * (unsigned long) sizeof(dict_file_entry_t);
+    if(memcmp(header->magic, DICT_MAGIC, DICT_MAGIC_LEN) != 0 || header->strings != index_end ||
+       index_end > bytes || header->strings_bytes != bytes - index_end ||
+       (header->count > 0) != (header->strings_bytes > 0) || (bytes > index_end && map[bytes - 1] != '\0')){
+        munmap((void *) map, info.st_size);
+        return NULL;
+    }
+
+    dictionary_t *dict = create_dictionary();
+    if(dict == NULL){
+        munmap((void *) map, info.st_size);
+        return NULL;
+    }
+    dict->backend = DICT_BACKEND_MAPPED;
+    dict->map = map;
+    dict->map_bytes = bytes;
+    dict->size = header->count;
+    if(dict->bloom_bits > 0){
+        bloom_build(dict, dict->size);
+    }
+    return dict;
+}
+
+/* Mapped find binary searches the index of a mapped dictionary for the query of length characters,
+    comparing the packed prefixes first so most steps never touch the string table. Returns 1 if
+    query is present and 0 otherwise.
+*/
+int mapped_find(const dictionary_t *dict, const char *query, unsigned length){
+    const dict_file_header_t *header = mapped_header(dict);
+    const dict_file_entry_t *entries = mapped_entries(dict);
+    unsigned prefix = word_prefix(query, length);
+    unsigned low = 0;
+    unsigned high = header->count;
+    while(low < high){
+        unsigned mid = low + (high - low) / 2;
+        int cmp;
+        if(entries[mid].prefix != prefix){
+            cmp = entries[mid].prefix < prefix ? -1 : 1;
+        }
+        else if(entries[mid].offset >= header->strings_bytes){
+            return 0; // damaged entry, the file can't be searched past it
+        }
+        else{
+            cmp = span_compare(mapped_word(dict, mid), query, length);
+        }
+        if(cmp == 0){
+            return 1;
+        }
+        if(cmp < 0){
+            low = mid + 1;
+        }
+        else{
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+/* Mapped words write prints every word of a mapped dictionary to the file handle, one per line
+    in ABC order like inorder_traversal_write. The string table is already in order so this is one
+    pass over it.
+*/
+void mapped_words_write(const dictionary_t *dict, FILE *file_handle){
+    const dict_file_header_t *header = mapped_header(dict);
+    const char *word = dict->map + header->strings;
+    const char *end = word + header->strings_bytes;
+    while(word < end){
+        fprintf(file_handle, "%s\n", word);
+        word += strlen(word) + 1;
+    }
+}
+
+/* Mapped thaw turns a mapped dictionary into a tree dictionary holding the same words so it can
+    be changed. The string table is copied into the string arena as it is and the sorted words are
+    built into a balanced tree with build_balanced, then the file is unmapped. Returns 0 on success
+    or -1 if memory can't be allocated, leaving the dictionary mapped.
+*/
+int mapped_thaw(dictionary_t *dict){
+    const dict_file_header_t *header = mapped_header(dict);
+    unsigned count = 0;
+    long start = 0;
+    if(header->strings_bytes > 0){
+        start = arena_add(dict, dict->map + header->strings, header->strings_bytes - 1);
+        if(start < 0){
+            return -1;
+        }
+    }
+    char **words = malloc((header->count > 0 ? header->count : 1) * sizeof(char *));
+    if(words == NULL){
+        return -1;
+    }
+    // walk the copied table rather than the index so a damaged offset can't point outside it
+    char *word = DICT_WORD(dict, start);
+    char *end = DICT_WORD(dict, dict->arena.used);
+    while(count < header->count && word < end){
+        words[count++] = word;
+        word += strlen(word) + 1;
+    }
+    int result = build_balanced(dict, words, count, &dict->root);
+    free(words);
+    if(result != 0){
+        return -1;
+    }
+    mapped_free(dict);
+    dict->backend = DICT_BACKEND_TREE;
+    dict->size = count;
+    return 0;
+}
+
+/* Mapped free unmaps the file of a mapped dictionary. Does nothing for other backends.
+*/
+void mapped_free(dictionary_t *dict){
+    if(dict->map != NULL){
+        munmap((void *) dict->map, dict->map_bytes);
+    }
+    dict->map = NULL;
+    dict->map_bytes = 0;
+}
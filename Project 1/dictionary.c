@@ -1,80 +1,252 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "dictionary.h"
 
 #define MAX_CMD_LEN 128
+#define WORD_PIECE_FORMAT "%127s" // one less than MAX_CMD_LEN to leave room for the null
 
-int binary_search(node_t *node, const char* query);
-void inorder_traversal(node_t *node);
-void traversal_free(node_t *node);
+// Backend used by create_dictionary(), set with dict_set_backend()
+static int dict_backend = DICT_BACKEND_TREE;
+
+// Bloom filter bits per word for create_dictionary(), set with dict_set_bloom()
+static unsigned dict_bloom_bits = 0;
+
+int binary_search(const dictionary_t *dict, const char* query, unsigned length);
+int node_height(node_t *node);
+void update_height(node_t *node);
+node_t *rotate_right(node_t *node);
+node_t *rotate_left(node_t *node);
+node_t *rebalance(node_t *node);
+node_t *new_node(dictionary_t *dict, const char *word);
+void inorder_traversal(const dictionary_t *dict, node_t *node);
+node_t *chunk_node(dictionary_t *dict);
+dictionary_t *bulk_load_tree(dictionary_t *dict, FILE *file_handle);
+long read_word(FILE *file_handle, char **word, unsigned long *capacity);
 void node_free(node_t *node);
 int string_compare(const char *node_word, const char *word);
-void inorder_traversal_write(node_t *node, FILE *file_handle);
+void inorder_traversal_write(const dictionary_t *dict, node_t *node, FILE *file_handle);
+void sorted_words_write(const dictionary_t *dict, FILE *file_handle);
+
+int dict_set_backend(int backend) {
+    if (backend != DICT_BACKEND_TREE && backend != DICT_BACKEND_HASH) {
+        return -1;
+    }
+    dict_backend = backend;
+    return 0;
+}
+
+int dict_set_bloom(unsigned bits_per_word) {
+    if (bits_per_word > 64) {
+        return -1;
+    }
+    dict_bloom_bits = bits_per_word;
+    return 0;
+}
 
 dictionary_t *create_dictionary() {
     dictionary_t *dict = malloc(sizeof(dictionary_t));
     if (dict == NULL) {
         return NULL;
     }
+    dict->backend = dict_backend;
     dict->root = NULL;
+    dict->chunks = NULL;
     dict->size = 0;
+    dict->slots = NULL;
+    dict->capacity = 0;
+    dict->arena.chars = NULL;
+    dict->arena.used = 0;
+    dict->arena.capacity = 0;
+    dict->map = NULL;
+    dict->map_bytes = 0;
+    dict->frozen = NULL;
+    dict->bloom_bits = dict_bloom_bits;
+    dict->bloom = NULL;
+    dict->bloom_blocks = 0;
+    dict->bloom_capacity = 0;
     return dict;
 }
 
-/*Insert helper gets a node and a word, this function assumes the node passed in is not null
-    Within the function, the word stored in the node will be compared against the word passed
-    to the function. If the word passed to the function is smaller, a new node will be created
-    on the left, otherwise on the right. This is a recursive function. returns 0
+/* Arena add copies length bytes of word and a null terminator to the end of the string arena,
+    doubling the arena when it is full. Offsets stay valid when the arena moves. Returns the offset
+    of the copy or -1 if memory can't be allocated or the arena would pass 4GB.
 */
-int insert_helper(node_t *node, const char *word){
-    if(strcmp(node->word, word) > 0){
-        if(node->left == NULL){
-            node->left = malloc(sizeof(node_t));
-            strcpy(node->left->word, word);
-            node->left->left = NULL;
-            node->left->right = NULL;
-            return 0;
+long arena_add(dictionary_t *dict, const char *word, unsigned length){
+    string_arena_t *arena = &dict->arena;
+    unsigned long need = arena->used + length + 1;
+    if(need > 0xFFFFFFFFUL){
+        return -1;
+    }
+    if(need > arena->capacity){
+        unsigned long capacity = arena->capacity > 0 ? arena->capacity : 4096;
+        while(capacity < need){
+            capacity *= 2;
         }
-        else{
-            insert_helper(node->left, word);
+        char *chars = realloc(arena->chars, capacity);
+        if(chars == NULL){
+            return -1;
         }
+        arena->chars = chars;
+        arena->capacity = capacity;
     }
-    else if(strcmp(node->word, word) < 0){
-        if(node->right == NULL){
-            node->right = malloc(sizeof(node_t));
-            strcpy(node->right->word, word);
-            node->right->left = NULL;
-            node->right->right = NULL;
-            return 0;
+    long offset = arena->used;
+    memcpy(arena->chars + offset, word, length);
+    arena->chars[offset + length] = '\0';
+    arena->used = need;
+    return offset;
+}
+
+/* Node height returns the height of the subtree rooted at node, 0 for an empty subtree.
+*/
+int node_height(node_t *node){
+    if(node == NULL){
+        return 0;
+    }
+    return node->height;
+}
+
+/* Update height recomputes the height of node from the heights of its children.
+*/
+void update_height(node_t *node){
+    int left = node_height(node->left);
+    int right = node_height(node->right);
+    node->height = (left > right ? left : right) + 1;
+}
+
+/* Rotate right lifts the left child of node into its place, keeping the words in order.
+    Returns the new root of the subtree.
+*/
+node_t *rotate_right(node_t *node){
+    node_t *left = node->left;
+    node->left = left->right;
+    left->right = node;
+    update_height(node);
+    update_height(left);
+    return left;
+}
+
+/* Rotate left lifts the right child of node into its place, keeping the words in order.
+    Returns the new root of the subtree.
+*/
+node_t *rotate_left(node_t *node){
+    node_t *right = node->right;
+    node->right = right->left;
+    right->left = node;
+    update_height(node);
+    update_height(right);
+    return right;
+}
+
+/* Rebalance restores the AVL property at node after an insert below it changed the height
+    of one of its subtrees by one. A single rotation fixes a subtree that is too tall on the
+    outside, and a double rotation one that is too tall on the inside. Returns the new root of
+    the subtree.
+*/
+node_t *rebalance(node_t *node){
+    update_height(node);
+    int balance = node_height(node->left) - node_height(node->right);
+    if(balance > 1){
+        if(node_height(node->left->left) < node_height(node->left->right)){
+            node->left = rotate_left(node->left);
         }
-        else{
-            insert_helper(node->right, word);
+        return rotate_right(node);
+    }
+    if(balance < -1){
+        if(node_height(node->right->right) < node_height(node->right->left)){
+            node->right = rotate_right(node->right);
         }
+        return rotate_left(node);
     }
+    return node;
+}
 
-    return 0;
+/* New node allocates a leaf node for word, adding the word to the string arena of dict.
+    Returns NULL if memory can't be allocated.
+*/
+node_t *new_node(dictionary_t *dict, const char *word){
+    unsigned length = strlen(word);
+    node_t *node = chunk_node(dict);
+    if(node == NULL){
+        return NULL;
+    }
+    long offset = arena_add(dict, word, length);
+    if(offset < 0){
+        dict->chunks->used--; // give the node back to its chunk
+        return NULL;
+    }
+    node->offset = offset;
+    node->length = length;
+    node->left = NULL;
+    node->right = NULL;
+    node->height = 1;
+    return node;
 }
 
+/* Dict insert walks down from the root without recursion, remembering the link followed at
+    each level. Once the new leaf is attached, it walks back up that path rebalancing each
+    node and storing the new root of each subtree in the link that led to it.
+*/
 int dict_insert(dictionary_t *dict, const char *word) {
-    if(dict->root == NULL){
-            dict->root = malloc(sizeof(node_t));
-            strcpy(dict->root->word, word);
-            dict->root->left = NULL;
-            dict->root->right = NULL;
-            return 0;
+    if(dict->backend == DICT_BACKEND_HASH){
+        return hash_insert(dict, word);
     }
-    else{
-        int result = insert_helper(dict->root, word);
-        dict->size = dict->size + 1;
-        return result;
+    if(dict->backend == DICT_BACKEND_MAPPED && mapped_thaw(dict) != 0){
+        return -1;
     }
-    
-    return -1;
+    if(dict->backend == DICT_BACKEND_FROZEN && frozen_thaw(dict) != 0){
+        return -1;
+    }
+
+    node_t **path[MAX_TREE_HEIGHT + 1];
+    int depth = 0;
+    node_t **link = &dict->root;
+    while(*link != NULL){
+        int cmp = strcmp(DICT_WORD(dict, (*link)->offset), word);
+        if(cmp == 0){
+            return 0; // already present
+        }
+        path[depth++] = link;
+        link = cmp > 0 ? &(*link)->left : &(*link)->right;
+    }
+
+    *link = new_node(dict, word);
+    if(*link == NULL){
+        return -1;
+    }
+    dict->size = dict->size + 1;
+    bloom_add(dict, word, (*link)->length);
+
+    while(depth > 0){
+        link = path[--depth];
+        int old_height = (*link)->height;
+        *link = rebalance(*link);
+        if((*link)->height == old_height){
+            break; // heights above are unchanged
+        }
+    }
+    return 0;
 }
 
 int dict_find(const dictionary_t *dict, const char *query) {
-    int find = binary_search(dict->root, query);
+    return dict_find_span(dict, query, strlen(query));
+}
+
+int dict_find_span(const dictionary_t *dict, const char *query, unsigned length) {
+    if(!bloom_may_contain(dict, query, length)){
+        return 0;
+    }
+    if(dict->backend == DICT_BACKEND_HASH){
+        return hash_find(dict, query, length);
+    }
+    if(dict->backend == DICT_BACKEND_MAPPED){
+        return mapped_find(dict, query, length);
+    }
+    if(dict->backend == DICT_BACKEND_FROZEN){
+        return frozen_find(dict, query, length);
+    }
+    int find = binary_search(dict, query, length);
     if(find == 0){
         return 0;
     }
@@ -86,12 +258,74 @@ void dict_print(const dictionary_t *dict) {
     if(dict == NULL){
         return;
     }
-    inorder_traversal(dict->root);
+    if(dict->backend == DICT_BACKEND_HASH || dict->backend == DICT_BACKEND_FROZEN){
+        sorted_words_write(dict, stdout);
+        return;
+    }
+    if(dict->backend == DICT_BACKEND_MAPPED){
+        mapped_words_write(dict, stdout);
+        return;
+    }
+    inorder_traversal(dict, dict->root);
     return;
 }
 
+/* Dict print stats prints how dict stores its words. The output resembles the following.
+
+    backend: tree
+    words: 400000
+    string arena: 3600000 of 4194304 bytes
+    tree height: 19
+    bloom filter: 6400000 bits (16.0 per word), 39.2% set, 0.0933% false positives
+*/
+void dict_print_stats(const dictionary_t *dict) {
+    const char *backend = "tree";
+    if(dict->backend == DICT_BACKEND_HASH){
+        backend = "hash";
+    }
+    else if(dict->backend == DICT_BACKEND_MAPPED){
+        backend = "mapped";
+    }
+    else if(dict->backend == DICT_BACKEND_FROZEN){
+        backend = "frozen";
+    }
+    printf("backend: %s\n", backend);
+    printf("words: %u\n", dict->size);
+    if(dict->backend == DICT_BACKEND_MAPPED){
+        printf("mapped file: %lu bytes\n", dict->map_bytes);
+    }
+    else{
+        printf("string arena: %lu of %lu bytes\n", dict->arena.used, dict->arena.capacity);
+    }
+    if(dict->backend == DICT_BACKEND_HASH){
+        printf("hash slots: %u, %.1f%% full\n", dict->capacity,
+               dict->capacity > 0 ? 100.0 * dict->size / dict->capacity : 0.0);
+    }
+    else if(dict->backend == DICT_BACKEND_TREE){
+        printf("tree height: %d\n", node_height(dict->root));
+    }
+    if(dict->bloom == NULL){
+        printf("bloom filter: off\n");
+        return;
+    }
+    double fill;
+    double rate = bloom_false_positive_rate(dict, &fill);
+    unsigned long bits = dict->bloom_blocks * (unsigned long) BLOOM_BLOCK_BITS;
+    printf("bloom filter: %lu bits (%.1f per word), %.1f%% set, %.4f%% false positives\n",
+           bits, dict->size > 0 ? (double) bits / dict->size : 0.0, 100.0 * fill, 100.0 * rate);
+}
+
 void dict_free(dictionary_t *dict) {
-    traversal_free(dict->root);
+    hash_free(dict);
+    mapped_free(dict);
+    free(dict->frozen);
+    free(dict->bloom);
+    while(dict->chunks != NULL){
+        node_chunk_t *chunk = dict->chunks;
+        dict->chunks = chunk->next;
+        free(chunk);
+    }
+    free(dict->arena.chars);
     free(dict);
 }
 
@@ -103,14 +337,29 @@ dictionary_t *read_dict_from_text_file(const char *file_name) {
     }
 
     dictionary_t *dict = create_dictionary();
-    char word[MAX_CMD_LEN];
+    if(dict == NULL){
+        fclose(file_handle);
+        return NULL;
+    }
+    if(dict->backend == DICT_BACKEND_TREE){
+        dict = bulk_load_tree(dict, file_handle);
+        fclose(file_handle);
+        return dict;
+    }
 
-    while(!feof(file_handle)){
-        fscanf(file_handle,"%s", word);
+    char *word = NULL;
+    unsigned long capacity = 0;
+    long length;
+    while((length = read_word(file_handle, &word, &capacity)) >= 0){
         dict_insert(dict, word);
     }
+    free(word);
 
     fclose(file_handle);
+    if(length == -2){
+        dict_free(dict);
+        return NULL;
+    }
 
     return dict;
 
@@ -123,85 +372,277 @@ int write_dict_to_text_file(const dictionary_t *dict, const char *file_name) {
     }
 
     //print to the file_handle
-    inorder_traversal_write(dict->root,file_handle);
+    if(dict->backend == DICT_BACKEND_HASH || dict->backend == DICT_BACKEND_FROZEN){
+        sorted_words_write(dict, file_handle);
+    }
+    else if(dict->backend == DICT_BACKEND_MAPPED){
+        mapped_words_write(dict, file_handle);
+    }
+    else{
+        inorder_traversal_write(dict, dict->root,file_handle);
+    }
     fclose(file_handle);
     
     return 0;
 }
 
-/* Binary search is a function used to find a node in the dictionary and say that it has been found.
-    This function takes a node and a char array query. It then recurses through the tree, until it
-    either finds a node that matches the found given and returns 1 or returns 0 otherwise
+/* Bulk load tree reads every word of the file into the string arena of an empty tree dictionary,
+    noting whether they came in sorted order, sorts them once if they didn't and drops duplicates,
+    then builds a perfectly balanced tree from the sorted words with build_balanced. Unlike inserting
+    the words one at a time this does no walks down the tree and no rotations. Returns dict, or
+    NULL after freeing it if memory can't be allocated.
 */
-int binary_search(node_t *node, const char *query){
-    //algorithm obtained from 4041 textbook
-    int result = 0;
-    if(node == NULL){
-        result = 0;
-        return result;
-    }
-    else{
-        if(strcmp(node->word, query) == 0){
-            result = 1;
-            return result;
+dictionary_t *bulk_load_tree(dictionary_t *dict, FILE *file_handle){
+    char *word = NULL;
+    unsigned long word_capacity = 0;
+    long length;
+    unsigned *offsets = NULL;
+    unsigned count = 0;
+    unsigned capacity = 0;
+    int sorted = 1;
+    long last = -1;
+
+    while((length = read_word(file_handle, &word, &word_capacity)) >= 0){
+        if(last >= 0){
+            int cmp = strcmp(DICT_WORD(dict, last), word);
+            if(cmp == 0){
+                continue; // repeat of the word before, nothing to add
+            }
+            if(cmp > 0){
+                sorted = 0;
+            }
         }
-        else if(strcmp(node->word, query) > 0){
-            return binary_search(node->left, query);
+        if(count == capacity){
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+            unsigned *grown = realloc(offsets, capacity * sizeof(unsigned));
+            if(grown == NULL){
+                length = -2;
+                break;
+            }
+            offsets = grown;
         }
-        else if(strcmp(node->word, query) < 0){
-            return binary_search(node->right, query);
+        last = arena_add(dict, word, length);
+        if(last < 0){
+            length = -2;
+            break;
         }
-        else{
-            result = 0;
+        offsets[count++] = last;
+    }
+    free(word);
+    if(length == -2){
+        free(offsets);
+        dict_free(dict);
+        return NULL;
+    }
+
+    // the arena no longer moves so words can be pointed to directly
+    char **words = malloc((count > 0 ? count : 1) * sizeof(char *));
+    if(words == NULL){
+        free(offsets);
+        dict_free(dict);
+        return NULL;
+    }
+    for(unsigned i = 0; i < count; i++){
+        words[i] = DICT_WORD(dict, offsets[i]);
+    }
+    free(offsets);
+
+    if(!sorted){
+        qsort(words, count, sizeof(char *), compare_words);
+        unsigned unique = 0;
+        for(unsigned i = 0; i < count; i++){
+            if(unique == 0 || strcmp(words[unique - 1], words[i]) != 0){
+                words[unique++] = words[i];
+            }
         }
+        count = unique;
     }
 
-    return result;
+    int result = build_balanced(dict, words, count, &dict->root);
+    free(words);
+    if(result != 0){
+        dict_free(dict);
+        return NULL;
+    }
+    dict->size = count;
+    if(dict->bloom_bits > 0){
+        bloom_build(dict, dict->size);
+    }
+    return dict;
+}
+
+/* Read word reads the next whitespace separated word from file_handle into *word, a malloc'd
+    buffer of *capacity bytes that starts out NULL and grows to fit. The word is read in pieces of
+    up to MAX_CMD_LEN - 1 characters, so words of any length come through whole and no fixed buffer
+    can overflow. Returns the length of the word, -1 at the end of the file or -2 if memory can't
+    be allocated.
+*/
+long read_word(FILE *file_handle, char **word, unsigned long *capacity){
+    char piece[MAX_CMD_LEN];
+    unsigned long length = 0;
+    if(fscanf(file_handle, WORD_PIECE_FORMAT, piece) != 1){
+        return -1;
+    }
+    while(1){
+        unsigned long piece_length = strlen(piece);
+        if(length + piece_length + 1 > *capacity){
+            unsigned long grown_capacity = *capacity > 0 ? *capacity * 2 : MAX_CMD_LEN;
+            while(grown_capacity < length + piece_length + 1){
+                grown_capacity *= 2;
+            }
+            char *grown = realloc(*word, grown_capacity);
+            if(grown == NULL){
+                return -2;
+            }
+            *word = grown;
+            *capacity = grown_capacity;
+        }
+        memcpy(*word + length, piece, piece_length + 1);
+        length += piece_length;
+        if(piece_length < MAX_CMD_LEN - 1){
+            return length; // fscanf stopped at whitespace or the end of the file
+        }
+        // a full piece may have stopped mid-word, carry on if no space follows
+        int c = getc(file_handle);
+        if(c == EOF){
+            return length;
+        }
+        ungetc(c, file_handle);
+        if(isspace(c) || fscanf(file_handle, WORD_PIECE_FORMAT, piece) != 1){
+            return length;
+        }
+    }
 }
 
-/* traversal free is a function used to free all the nodes. It is based off of the inorder traversal
-used to go throughout a binary search tree. This will recurse all the way down to the leaves and free
-as it works its way up. This function takes in a node as a parameter and returns nothing.
+/* Build balanced makes a node for the middle word of the sorted array words and builds the words
+    before and after it into its left and right subtrees, storing the root in *link. Each half is
+    within one word of the other so the tree is as short as possible and meets the AVL property.
+    Every word is visited once so this takes O(n) time. Returns 0 on success or -1 if memory can't
+    be allocated.
 */
-void traversal_free(node_t *node){
-    if(node == NULL){ 
-       return;
+int build_balanced(dictionary_t *dict, char **words, unsigned count, node_t **link){
+    if(count == 0){
+        *link = NULL;
+        return 0;
     }
-    else {
-        traversal_free(node->left);
-        traversal_free(node->right);
-        free(node);
+    unsigned mid = count / 2;
+    node_t *node = chunk_node(dict);
+    if(node == NULL){
+        *link = NULL;
+        return -1;
+    }
+    node->offset = words[mid] - dict->arena.chars;
+    node->length = strlen(words[mid]);
+    *link = node;
+    if(build_balanced(dict, words, mid, &node->left) != 0 ||
+       build_balanced(dict, words + mid + 1, count - mid - 1, &node->right) != 0){
+        return -1;
+    }
+    update_height(node);
+    return 0;
+}
+
+/* Binary search is a function used to find a node in the dictionary and say that it has been found.
+    This function takes a dictionary and a query of length characters, which need not be null-terminated.
+    It walks down the tree from the root in a loop, comparing once per level, until it either finds a node
+    that matches and returns 1 or runs off the tree and returns 0. The tree is balanced so this takes
+    O(log n) steps.
+*/
+int binary_search(const dictionary_t *dict, const char *query, unsigned length){
+    node_t *node = dict->root;
+    while(node != NULL){
+        unsigned shorter = node->length < length ? node->length : length;
+        int cmp = memcmp(DICT_WORD(dict, node->offset), query, shorter);
+        if(cmp == 0){
+            cmp = (node->length > length) - (node->length < length); // a prefix sorts first
+        }
+        if(cmp == 0){
+            return 1;
+        }
+        node = cmp > 0 ? node->left : node->right;
     }
+    return 0;
+}
 
-    return;
+/* Chunk node hands out the next unused node of the current node chunk of dict, starting a new
+    chunk twice the size of the last one when it is full. Nodes inserted one after another end up
+    next to each other in memory and dict_free only frees a few chunks. Returns NULL if memory
+    can't be allocated.
+*/
+node_t *chunk_node(dictionary_t *dict){
+    node_chunk_t *chunk = dict->chunks;
+    if(chunk == NULL || chunk->used == chunk->capacity){
+        unsigned capacity = NODE_CHUNK_MIN;
+        if(chunk != NULL){
+            capacity = chunk->capacity < NODE_CHUNK_MAX ? chunk->capacity * 2 : NODE_CHUNK_MAX;
+        }
+        node_chunk_t *fresh = malloc(sizeof(node_chunk_t) + capacity * sizeof(node_t));
+        if(fresh == NULL){
+            return NULL;
+        }
+        fresh->next = chunk;
+        fresh->used = 0;
+        fresh->capacity = capacity;
+        dict->chunks = fresh;
+        chunk = fresh;
+    }
+    return &chunk->nodes[chunk->used++];
 }
 
-/* Inorder traversal is a function used to print all the nodes of the tree in ABC order. It takes a node
-as a parameter. It recurses through the tree, working its way down first through the left side and then
+/* Inorder traversal is a function used to print all the nodes of the tree in ABC order. It takes the
+dictionary holding the words and a node as parameters. It recurses through the tree, working its way down first through the left side and then
 printing nodes, and then through the right side. 
 */
-void inorder_traversal(node_t *node){
+void inorder_traversal(const dictionary_t *dict, node_t *node){
     //algorithom obtained from 4041 textbook
     if(node == NULL){
         return;
     }
 
-    inorder_traversal(node->left); //recur on left side
-    printf("%s\n", node->word); //print word of node
-    inorder_traversal(node->right); //recur on right side
+    inorder_traversal(dict, node->left); //recur on left side
+    printf("%s\n", DICT_WORD(dict, node->offset)); //print word of node
+    inorder_traversal(dict, node->right); //recur on right side
+}
+
+/* Inorder words stores pointers to the words of the subtree rooted at node in ABC order into
+    words, starting at index *count and advancing *count past them.
+*/
+void inorder_words(const dictionary_t *dict, node_t *node, const char **words, unsigned *count){
+    if(node == NULL){
+        return;
+    }
+
+    inorder_words(dict, node->left, words, count);
+    words[(*count)++] = DICT_WORD(dict, node->offset);
+    inorder_words(dict, node->right, words, count);
 }
 
 /* Inorder traversal write is a function based off of inorder traversing through a binary search tree. 
-    This function takes in a node and a file handle. It will then recurse through the tree, starting at
+    This function takes in the dictionary, a node and a file handle. It will then recurse through the tree, starting at
     left most leaf and print to the file passed and will continue until it has gone through every node in
     the dictionary
 */
-void inorder_traversal_write(node_t *node, FILE *file_handle){
+void inorder_traversal_write(const dictionary_t *dict, node_t *node, FILE *file_handle){
     if(node == NULL){
         return;
     }
 
-    inorder_traversal_write(node->left, file_handle);
-    fprintf(file_handle, "%s\n", node->word);
-    inorder_traversal_write(node->right, file_handle);
-}
\ No newline at end of file
+    inorder_traversal_write(dict, node->left, file_handle);
+    fprintf(file_handle, "%s\n", DICT_WORD(dict, node->offset));
+    inorder_traversal_write(dict, node->right, file_handle);
+}
+
+/* Sorted words write prints every word of a hash table or frozen dictionary to the file handle, one
+    per line in ABC order like inorder_traversal_write. The hash table has no order of its own so the
+    words are sorted first, and the frozen array is put back in order.
+*/
+void sorted_words_write(const dictionary_t *dict, FILE *file_handle){
+    const char **words = dict_sorted_words(dict);
+    if(words == NULL){
+        return;
+    }
+    for(unsigned i = 0; i < dict->size; i++){
+        fprintf(file_handle, "%s\n", words[i]);
+    }
+    free(words);
+}
@@ -1,21 +1,138 @@
 #ifndef DICTIONARY_H
 #define DICTIONARY_H
 
+#include <stdio.h>
+
 #define MAX_WORD_LEN 128
+#define MAX_TREE_HEIGHT 64 // AVL trees this tall would hold far more than 2^32 words
 
-// Data type for nodes in binary search tree
+// Data type for nodes in an AVL tree, a binary search tree which keeps
+// the heights of the two subtrees of every node within one of each other.
+// The word itself is kept in the dictionary's string arena.
 typedef struct node {
-    char word[MAX_WORD_LEN]; // Word, as a null-terminated string
+    unsigned offset;         // Offset of the word in the string arena
+    unsigned length;         // Length of the word, not counting the null terminator
     struct node *left;       // Left child in tree, NULL if no child
     struct node *right;      // Right child in tree, NULL if no child
+    int height;              // Height of the subtree rooted here, 1 for a leaf
 } node_t;
 
+// Data type for the string arena holding every word of a dictionary back
+// to back as null-terminated strings, so words take only the space they
+// need and neighbouring words share cache lines
+typedef struct {
+    char *chars;             // Storage for the words, NULL until the first word is added
+    unsigned long used;      // Bytes of chars holding words
+    unsigned long capacity;  // Bytes allocated for chars
+} string_arena_t;
+
+// Number of nodes in the first node chunk of a dictionary; each further
+// chunk is twice as large as the one before, up to NODE_CHUNK_MAX nodes
+#define NODE_CHUNK_MIN 64
+#define NODE_CHUNK_MAX 65536
+
+// Data type for a chunk of tree nodes. Nodes are handed out in order from
+// the chunk and never freed one at a time; dict_free() frees whole chunks.
+typedef struct node_chunk {
+    struct node_chunk *next; // Chunk allocated before this one, NULL for the first
+    unsigned used;           // Number of nodes handed out from this chunk
+    unsigned capacity;       // Number of nodes in this chunk
+    node_t nodes[];          // The nodes themselves
+} node_chunk_t;
+
+// The word stored at offset in the arena of dict, as a null-terminated string
+#define DICT_WORD(dict, offset) ((dict)->arena.chars + (offset))
+
+// Ways a dictionary can store its words, chosen with dict_set_backend()
+#define DICT_BACKEND_TREE 0 // AVL tree (default)
+#define DICT_BACKEND_HASH 1 // Robin Hood open-addressing hash table
+#define DICT_BACKEND_MAPPED 2 // Read-only binary file mapped with open_dict_mmap()
+#define DICT_BACKEND_FROZEN 3 // Read-only Eytzinger array made by dict_freeze()
+
+// Data type for an entry of the Eytzinger array of a frozen dictionary
+typedef struct {
+    unsigned long prefix; // First 8 bytes of the word, big-endian, so comparing prefixes orders words like strcmp
+    unsigned offset;      // Offset of the word in the string arena
+    unsigned length;      // Length of the word
+} frozen_entry_t;
+
+// Binary dictionary files start with this magic string, written by
+// write_dict_to_binary_file() and checked by open_dict_mmap()
+#define DICT_MAGIC "SPELLDB1"
+#define DICT_MAGIC_LEN 8
+
+// Header at the start of a binary dictionary file. The file is laid out as
+// the header, then count index entries sorted by word, then the string
+// table of the words back to back as null-terminated strings in the same
+// order. Every position is an offset so the file works wherever it is
+// mapped. Numbers are stored in the byte order of the machine that wrote it.
+typedef struct {
+    char magic[DICT_MAGIC_LEN]; // DICT_MAGIC, not null-terminated
+    unsigned count;             // Number of words
+    unsigned reserved;          // Always 0
+    unsigned long strings;      // Offset of the string table from the start of the file
+    unsigned long strings_bytes; // Size of the string table in bytes
+} dict_file_header_t;
+
+// Index entry for one word of a binary dictionary file
+typedef struct {
+    unsigned prefix;  // First 4 bytes of the word, big-endian, so comparing prefixes orders words like strcmp
+    unsigned offset;  // Offset of the word in the string table
+} dict_file_entry_t;
+
+// Bits per word a Bloom filter uses once dict_set_bloom() switches it on,
+// unless another number is given; 16 keeps false positives well under 1%
+#define BLOOM_DEFAULT_BITS 16
+#define BLOOM_BLOCK_WORDS 8                    // 64-bit words in a filter block
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64) // bits in a filter block, one cache line
+
+// Data type for a block of a Bloom filter
+typedef struct {
+    unsigned long bits[BLOOM_BLOCK_WORDS]; // Each word added sets one bit in each of these
+} bloom_block_t;
+
+// Data type for slots in the hash table backend
+typedef struct {
+    unsigned long hash;  // Cached hash of the word so most mismatches skip strcmp
+    unsigned word;       // Offset of the word in the string arena plus one, 0 if slot is empty
+    unsigned length;     // Length of the word, also compared before strcmp
+} hash_slot_t;
+
 // Data type for a dictionary
 typedef struct {
-    node_t *root;   // Root of binary search tree storing words, NULL if empty
-    unsigned size;  // Total number of nodes in tree, 0 if empty
+    int backend;         // DICT_BACKEND_TREE, DICT_BACKEND_HASH, DICT_BACKEND_MAPPED or DICT_BACKEND_FROZEN
+    node_t *root;        // Root of binary search tree storing words, NULL if empty
+    node_chunk_t *chunks; // Chunk nodes are currently taken from, NULL until first insert
+    unsigned size;       // Total number of words stored, 0 if empty
+    hash_slot_t *slots;  // Hash table for DICT_BACKEND_HASH, NULL until first insert
+    unsigned capacity;   // Number of slots in the hash table, a power of two
+    string_arena_t arena; // Storage for the words of the tree and hash backends
+    const char *map;     // Mapping of a binary dictionary file for DICT_BACKEND_MAPPED, NULL otherwise
+    unsigned long map_bytes; // Size of the mapping in bytes
+    frozen_entry_t *frozen; // Eytzinger array for DICT_BACKEND_FROZEN, entry 0 unused, NULL otherwise
+    unsigned bloom_bits; // Filter bits per word, 0 if the dictionary has no Bloom filter
+    bloom_block_t *bloom; // Bloom filter checked before searching, NULL until first insert
+    unsigned bloom_blocks; // Number of blocks in the filter
+    unsigned bloom_capacity; // Number of words the filter was sized for, rebuilt past this
 } dictionary_t;
 
+/*
+ * Choose how dictionaries created from now on store their words
+ * backend: DICT_BACKEND_TREE or DICT_BACKEND_HASH
+ * Returns: 0 on success or -1 if backend is not valid
+ */
+int dict_set_backend(int backend);
+
+/*
+ * Choose whether dictionaries created from now on keep a Bloom filter of
+ * their words, which lets dict_find() reject most missing words without
+ * searching. Text dictionaries build it as they are read and binary
+ * dictionaries as open_dict_mmap() maps them.
+ * bits_per_word: Filter bits for each word, 0 to keep no filter
+ * Returns: 0 on success or -1 if bits_per_word is more than 64
+ */
+int dict_set_bloom(unsigned bits_per_word);
+
 /*
  * Create a new empty dictionary
  * Returns: Pointer to a dictionary_t representing an empty dictionary
@@ -24,10 +141,11 @@ typedef struct {
 dictionary_t *create_dictionary();
 
 /*
- * Add a new word to the dictionary (insert into the binary search tree)
+ * Add a new word to the dictionary (insert into the AVL tree, rebalancing
+ * it so lookups stay O(log n) whatever order words are added in)
  * dict: A pointer to a dictionary to add the word to
  * word: The new word to add, as a null-terminated string
- * Returns: 0 if the word was successfully added
+ * Returns: 0 if the word was successfully added or was already present
  *          or -1 if the word could not be added
  */
 int dict_insert(dictionary_t *dict, const char *word);
@@ -40,12 +158,40 @@ int dict_insert(dictionary_t *dict, const char *word);
  */
 int dict_find(const dictionary_t *dict, const char *query);
 
+/*
+ * Search for a word given as a span of characters, such as a token inside
+ * a larger buffer, without copying it into a null-terminated string
+ * dict: A pointer to the dictionary to search
+ * query: The first character of the word, need not be null-terminated
+ * length: The number of characters in the word
+ * Returns: 1 if the word was found in the dictionary, 0 otherwise
+ */
+int dict_find_span(const dictionary_t *dict, const char *query, unsigned length);
+
+/*
+ * Convert a dictionary that won't change any more into a sorted array in
+ * Eytzinger order, which dict_find() searches several times faster than
+ * the tree. The words stay where they are; the tree or hash table is freed.
+ * Adding a word afterwards turns the dictionary back into an AVL tree.
+ * dict: A pointer to the dictionary to freeze
+ * Returns: 0 on success or -1 if memory can't be allocated, leaving the
+ *          dictionary as it was
+ */
+int dict_freeze(dictionary_t *dict);
+
 /*
  * Print out all words in a dictionary, sorted alphabetically
  * dict: A pointer to the dictionary containing all words to print
  */
 void dict_print(const dictionary_t *dict);
 
+/*
+ * Print out statistics about how a dictionary stores its words, including
+ * the estimated false positive rate of its Bloom filter
+ * dict: A pointer to the dictionary to describe
+ */
+void dict_print_stats(const dictionary_t *dict);
+
 /*
  * Frees all memory used to store the contents of a dictionary
  * dict: A pointer to the dictionary to free
@@ -53,7 +199,9 @@ void dict_print(const dictionary_t *dict);
 void dict_free(dictionary_t *dict);
 
 /*
- * Create a new dictionary containing all words listed in a text file
+ * Create a new dictionary containing all words listed in a text file. A
+ * tree dictionary is built balanced in one pass over the sorted words,
+ * which costs O(n) when the file is already sorted and one sort otherwise
  * file_name: The name of the file to read words from
  * Returns: A pointer to a new dictionary containing all of the file's words
  *          or NULL if the read operation fails
@@ -68,4 +216,55 @@ dictionary_t *read_dict_from_text_file(const char *file_name);
  */
 int write_dict_to_text_file(const dictionary_t *dict, const char *file_name);
 
+/*
+ * Writes the contents of a dictionary to a binary dictionary file, which
+ * open_dict_mmap() can use without parsing it
+ * dict: The dictionary to write
+ * file_name: The name of the binary file to write to
+ * Returns: 0 on success or 1 on failure, like write_dict_to_text_file()
+ */
+int write_dict_to_binary_file(const dictionary_t *dict, const char *file_name);
+
+/*
+ * Maps a binary dictionary file into memory and returns a dictionary that
+ * searches it in place. Adding a word to the dictionary copies its words
+ * into an AVL tree first.
+ * file_name: The name of the binary file to map
+ * Returns: A pointer to a dictionary using the mapped file, or NULL if the
+ *          file can't be opened or is not a binary dictionary file
+ */
+dictionary_t *open_dict_mmap(const char *file_name);
+
+// String arena and tree helpers, defined in dictionary.c
+long arena_add(dictionary_t *dict, const char *word, unsigned length);
+int build_balanced(dictionary_t *dict, char **words, unsigned count, node_t **link);
+void inorder_words(const dictionary_t *dict, node_t *node, const char **words, unsigned *count);
+
+// Hash table backend, defined in dict_hash.c
+unsigned long hash_span(const char *word, unsigned length);
+int hash_insert(dictionary_t *dict, const char *word);
+int hash_find(const dictionary_t *dict, const char *query, unsigned length);
+const char **hash_sorted_words(const dictionary_t *dict);
+int compare_words(const void *a, const void *b);
+void hash_free(dictionary_t *dict);
+
+// Bloom filter, defined in dict_bloom.c
+void bloom_build(dictionary_t *dict, unsigned long capacity);
+void bloom_add(dictionary_t *dict, const char *word, unsigned length);
+int bloom_may_contain(const dictionary_t *dict, const char *query, unsigned length);
+double bloom_false_positive_rate(const dictionary_t *dict, double *fill);
+
+// Frozen backend, defined in dict_frozen.c
+int frozen_find(const dictionary_t *dict, const char *query, unsigned length);
+const char **frozen_sorted_words(const dictionary_t *dict);
+int frozen_thaw(dictionary_t *dict);
+
+// Mapped binary backend, defined in dict_mmap.c
+const char **dict_sorted_words(const dictionary_t *dict);
+const dict_file_header_t *mapped_header(const dictionary_t *dict);
+int mapped_find(const dictionary_t *dict, const char *query, unsigned length);
+void mapped_words_write(const dictionary_t *dict, FILE *file_handle);
+int mapped_thaw(dictionary_t *dict);
+void mapped_free(dictionary_t *dict);
+
 #endif // DICTIONARY_H
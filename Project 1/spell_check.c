@@ -1,68 +1,294 @@
 #include <ctype.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "dictionary.h"
 
 #define MAX_CMD_LEN 128
+#define CHECK_BUFFER_LEN (1 << 20) // bytes read from the file to check at a time, per thread
+#define MAX_JOBS 64                // most threads -j can ask for
+
+// Return 1 if the 8 bytes of chunk have a byte below '!', which every
+// whitespace character is, by the usual trick for finding a small byte
+// in a word. Most 8-byte chunks of text are inside a word and pass with
+// one test instead of eight.
+static int chunk_has_space(unsigned long chunk){
+    return ((chunk - 0x2121212121212121UL) & ~chunk & 0x8080808080808080UL) != 0;
+}
+
+// Return the index of the first whitespace character at or after start
+// and before end in buf, or end if there is none
+static size_t token_end(const char *buf, size_t start, size_t end){
+    size_t i = start;
+    while(i + 8 <= end){
+        unsigned long chunk;
+        memcpy(&chunk, buf + i, 8);
+        if(chunk_has_space(chunk)){
+            break;
+        }
+        i += 8;
+    }
+    while(i < end && !isspace((unsigned char) buf[i])){
+        i++;
+    }
+    return i;
+}
+
+// Write each word of buf from start up to end to out, followed by a
+// space if it is in dict and by "[X] " if it isn't, and by a newline if
+// the word is directly followed by one. Every word must end before end,
+// so end should follow whitespace or be the end of the file.
+static void check_words(const char *buf, size_t start, size_t end,
+                        const dictionary_t *dict, FILE *out){
+    size_t pos = start;
+    while(1){
+        while(pos < end && isspace((unsigned char) buf[pos])){
+            pos++;
+        }
+        if(pos >= end){
+            return;
+        }
+        size_t word_end = token_end(buf, pos, end);
+        fwrite(buf + pos, 1, word_end - pos, out);
+        if(dict_find_span(dict, buf + pos, word_end - pos) == 1){
+            fputs(" ", out);
+        }
+        else{
+            fputs("[X] ", out);
+        }
+        if(word_end < end && buf[word_end] == '\n'){
+            fputs("\n", out);
+        }
+        pos = word_end + 1;
+    }
+}
+
+// Work for one thread of a parallel spell check: the chunk of the buffer
+// it checks and the annotated output it writes into memory
+typedef struct {
+    const char *buf;          // Buffer holding the chunk
+    size_t start;             // First byte of the chunk
+    size_t end;               // Byte after the chunk, just after whitespace
+    const dictionary_t *dict; // Dictionary shared read-only by every thread
+    char *out;                // Output for the chunk, malloc'd by open_memstream
+    size_t out_len;           // Bytes of output
+    int done;                 // 1 once out holds the whole output of the chunk
+} check_job_t;
+
+// Thread body for check_parallel, checking one chunk into memory
+static void *check_job(void *arg){
+    check_job_t *job = arg;
+    FILE *out = open_memstream(&job->out, &job->out_len);
+    if(out == NULL){
+        return NULL;
+    }
+    check_words(job->buf, job->start, job->end, job->dict, out);
+    job->done = fclose(out) == 0;
+    return NULL;
+}
+
+// Check the words of buf up to end like check_words with jobs threads.
+// The range is cut into jobs chunks of about the same size, each cut
+// placed just after a whitespace character so no word or newline
+// decision spans two chunks. Each thread writes its chunk's output to
+// memory and the outputs are written to stdout in order once all are
+// done, so the output is the same as checking serially. A chunk whose
+// thread can't be started or whose output can't be kept is checked here
+// in its turn instead.
+static void check_parallel(const char *buf, size_t end, const dictionary_t *dict, int jobs){
+    check_job_t job[jobs];
+    pthread_t thread[jobs];
+    int started[jobs];
+    size_t cut = 0;
+    for(int j = 0; j < jobs; j++){
+        job[j].buf = buf;
+        job[j].start = cut;
+        cut = j == jobs - 1 ? end : end / jobs * (j + 1);
+        if(cut < job[j].start){
+            cut = job[j].start;
+        }
+        while(cut > 0 && cut < end && !isspace((unsigned char) buf[cut - 1])){
+            cut++;
+        }
+        job[j].end = cut;
+        job[j].dict = dict;
+        job[j].out = NULL;
+        job[j].out_len = 0;
+        job[j].done = 0;
+        started[j] = pthread_create(&thread[j], NULL, check_job, &job[j]) == 0;
+    }
+    fflush(stdout);
+    for(int j = 0; j < jobs; j++){
+        if(started[j]){
+            pthread_join(thread[j], NULL);
+        }
+        if(job[j].done){
+            fwrite(job[j].out, 1, job[j].out_len, stdout);
+        }
+        else{
+            check_words(buf, job[j].start, job[j].end, dict, stdout);
+        }
+        free(job[j].out);
+    }
+}
 
 // A helper function to spell check a specific file
 // 'file_name': Name of the file to spell check
 // 'dict': A dictionary containing correct words
-int spell_check_file(const char *file_name, const dictionary_t *dict){
+// 'jobs': Number of threads to check with, 1 to check serially
+// The file is read a large buffer at a time and each word is looked up
+// where it lies in the buffer, so words of any length are fine. A newline
+// is printed wherever a word is directly followed by one, as reading each
+// word with fscanf and the character after it with fgetc used to.
+int spell_check_file(const char *file_name, const dictionary_t *dict, int jobs){
     FILE *file_handle = fopen(file_name, "r");
     if(file_handle == NULL){
         return -1;
     }
-    char word[MAX_WORD_LEN];
+    size_t capacity = CHECK_BUFFER_LEN * (size_t) jobs;
+    char *buf = malloc(capacity);
+    if(buf == NULL){
+        fclose(file_handle);
+        return -1;
+    }
 
-    while(!feof(file_handle)){
-        if(fscanf(file_handle,"%s", word) > 0){
-            int find = dict_find(dict, word);
-            if(find == 1){
-                printf("%s ", word);
-            }
-            else if (find == 0){
-                printf("%s[X] ", word);
+    size_t len = 0;  // bytes of buf holding file contents not yet checked
+    int at_eof = 0;
+    while(!at_eof){
+        if(len == capacity){
+            // a single word fills the buffer, make room for the rest of it
+            char *grown = realloc(buf, capacity * 2);
+            if(grown == NULL){
+                free(buf);
+                fclose(file_handle);
+                return -1;
             }
+            buf = grown;
+            capacity *= 2;
         }
-        int space = fgetc(file_handle);
-        if(isspace(space) > 0){
-            if(space == 10){
-                printf("\n");
-            }
+        size_t got = fread(buf + len, 1, capacity - len, file_handle);
+        at_eof = got == 0;
+        len += got;
+
+        // only check up to the last whitespace, the word after it may go on past the buffer
+        size_t end = len;
+        while(!at_eof && end > 0 && !isspace((unsigned char) buf[end - 1])){
+            end--;
+        }
+        if(jobs > 1 && end >= CHECK_BUFFER_LEN){
+            check_parallel(buf, end, dict, jobs);
+        }
+        else{
+            check_words(buf, 0, end, dict, stdout);
         }
+        memmove(buf, buf + end, len - end);
+        len -= end;
     }
 
+    free(buf);
     fclose(file_handle);
     return 0;
 }
 
+// A helper function to load a dictionary, mapping it in place if it is a
+// binary dictionary file and reading it as text otherwise
+// 'file_name': Name of the dictionary file
+dictionary_t *load_dict_file(const char *file_name){
+    dictionary_t *dict = open_dict_mmap(file_name);
+    if(dict != NULL){
+        printf("Dictionary successfully mapped from binary file\n");
+        return dict;
+    }
+    dict = read_dict_from_text_file(file_name);
+    if(dict == NULL){
+        printf("Failed to read dictionary from text file\n");
+    }
+    else{
+        printf("Dictionary successfully read from text file\n");
+    }
+    return dict;
+}
+
+// A helper function to save a dictionary, as a binary dictionary file if
+// the name ends in .bin and as text otherwise
+// 'file_name': Name of the file to write
+// 'dict': The dictionary to save
+void save_dict_file(const char *file_name, const dictionary_t *dict){
+    size_t len = strlen(file_name);
+    if(len >= 4 && strcmp(file_name + len - 4, ".bin") == 0){
+        if(write_dict_to_binary_file(dict, file_name) != 0){
+            printf("Failed to write dictionary to binary file\n");
+        }
+        else{
+            printf("Dictionary successfully written to binary file\n");
+        }
+        return;
+    }
+    int save = write_dict_to_text_file(dict, file_name);
+    if(save == 1){
+        printf("Failed to write dictionary from text file\n");
+    }
+    else{
+        printf("Dictionary successfully written to text file\n");
+    }
+}
+
 /*
  * This is in general *very* similar to the list_main file seen in lab
+ * Options: -b tree|hash chooses how the dictionary stores its words
+ *          -f keeps a Bloom filter to reject most misspelled words quickly
+ *          -j N checks files with N threads, with the same output
+ * The stats command prints how the dictionary stores its words, and the
+ * freeze command makes it a read-only array that is faster to search.
+ * A tree dictionary given on the command line is frozen once loaded, as
+ * nothing is added to it after that.
+ * load and the dictionary_file argument also accept binary dictionary
+ * files, and save writes one when the file name ends in .bin
  */
 int main(int argc, char **argv) {
+    int opt;
+    int jobs = 1;
+    while((opt = getopt(argc, argv, "b:fj:")) != -1){
+        if(opt == 'b' && strcmp(optarg, "tree") == 0){
+            dict_set_backend(DICT_BACKEND_TREE);
+        }
+        else if(opt == 'b' && strcmp(optarg, "hash") == 0){
+            dict_set_backend(DICT_BACKEND_HASH);
+        }
+        else if(opt == 'f'){
+            dict_set_bloom(BLOOM_DEFAULT_BITS);
+        }
+        else if(opt == 'j' && atoi(optarg) > 0 && atoi(optarg) <= MAX_JOBS){
+            jobs = atoi(optarg);
+        }
+        else{
+            printf("Usage: %s [-b tree|hash] [-f] [-j N] [dictionary_file [file_to_check]]\n", argv[0]);
+            return 1;
+        }
+    }
+
     dictionary_t *dict = create_dictionary();
     char cmd[MAX_CMD_LEN];
 
-    if(argc > 1){
-        for(int i = 1; i < argc; i++){
-            if(i == 1){
-                dictionary_t *dict_r = read_dict_from_text_file(argv[i]);
+    if(argc > optind){
+        for(int i = optind; i < argc; i++){
+            if(i == optind){
+                dictionary_t *dict_r = load_dict_file(argv[i]);
                 if(dict_r == NULL){
-                    printf("Failed to read dictionary from text file\n");
                     break;
                 }
-                else{
-                    printf("Dictionary successfully read from text file\n");
-                    dict_free(dict);
-                    dict = dict_r;
+                dict_free(dict);
+                dict = dict_r;
+                if(dict->backend == DICT_BACKEND_TREE){
+                    dict_freeze(dict);
                 }
                 continue;
             }
-            else if(i == 2){
-                int check = spell_check_file(argv[i], dict);
+            else if(i == optind + 1){
+                int check = spell_check_file(argv[i], dict, jobs);
                 if(check == -1){
                     printf("Spell check failed\n");
                 }
@@ -79,6 +305,8 @@ int main(int argc, char **argv) {
         printf("  load <file_name>:        reads in dictionary from a file\n");
         printf("  save <file_name>:        writes dictionary to a file\n");
         printf("  check <file_name>: spell checks the specified file\n");
+        printf("  stats:                   shows how the dictionary stores its words\n");
+        printf("  freeze:                  makes the dictionary a read-only array for faster lookups\n");
         printf("  exit:                    exits the program\n");
 
         while (1) {
@@ -114,14 +342,22 @@ int main(int argc, char **argv) {
                 continue;
             }
 
+            if(strcmp("stats", cmd) == 0){
+                dict_print_stats(dict);
+                continue;
+            }
+
+            if(strcmp("freeze", cmd) == 0){
+                if(dict_freeze(dict) != 0){
+                    printf("Failed to freeze dictionary\n");
+                }
+                continue;
+            }
+
             if(strcmp("load", cmd) == 0){
                 scanf("%s", cmd);
-                dictionary_t *dict_r = read_dict_from_text_file(cmd);
-                if(dict_r == NULL){
-                    printf("Failed to read dictionary from text file\n");
-                }
-                else{
-                    printf("Dictionary successfully read from text file\n");
+                dictionary_t *dict_r = load_dict_file(cmd);
+                if(dict_r != NULL){
                     dict_free(dict);
                     dict = dict_r;
                 }
@@ -130,20 +366,13 @@ int main(int argc, char **argv) {
 
             if(strcmp("save", cmd) == 0){
                 scanf("%s", cmd);
-                int save = write_dict_to_text_file(dict, cmd);
-                if(save == 1){
-                    printf("Failed to write dictionary from text file\n");
-                }
-                else{
-                    printf("Dictionary successfully written to text file\n");
-                }
-
+                save_dict_file(cmd, dict);
                 continue;
             }
 
             if(strcmp("check", cmd) == 0){
                 scanf("%s", cmd);
-                int check = spell_check_file(cmd, dict);
+                int check = spell_check_file(cmd, dict, jobs);
                 if(check == -1){
                     printf("Spell check failed\n");
                 }
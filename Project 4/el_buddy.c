@@ -0,0 +1,209 @@
+// el_buddy.c: binary buddy backend for the el_malloc() API, selected
+// with el_set_backend(EL_BACKEND_BUDDY) before el_init().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "el_malloc.h"
+
+// Number of bits in each word of the free bitmaps
+#define EL_BUDDY_WORD_BITS 64
+
+// Return the bitmap word holding bit i of the free bitmap for order
+static unsigned long *el_buddy_word(int order, size_t i) {
+    el_buddy_t *buddy = &el_ctl.buddy;
+    return &buddy->bitmap[buddy->word_offset[order] + i / EL_BUDDY_WORD_BITS];
+}
+
+// Return 1 if block i of the given order is free, 0 otherwise
+static int el_buddy_is_free(int order, size_t i) {
+    return (*el_buddy_word(order, i) >> (i % EL_BUDDY_WORD_BITS)) & 1;
+}
+
+// Mark block i of the given order as free
+static void el_buddy_set_free(int order, size_t i) {
+    *el_buddy_word(order, i) |= 1UL << (i % EL_BUDDY_WORD_BITS);
+    el_ctl.buddy.free_count[order]++;
+}
+
+// Mark block i of the given order as not free
+static void el_buddy_clear_free(int order, size_t i) {
+    *el_buddy_word(order, i) &= ~(1UL << (i % EL_BUDDY_WORD_BITS));
+    el_ctl.buddy.free_count[order]--;
+}
+
+// Return the index of the lowest free block of the given order. The
+// order must have at least one free block.
+static size_t el_buddy_first_free(int order) {
+    el_buddy_t *buddy = &el_ctl.buddy;
+    unsigned long *word = &buddy->bitmap[buddy->word_offset[order]];
+    while (*word == 0) {
+        word++;
+    }
+    size_t w = word - &buddy->bitmap[buddy->word_offset[order]];
+    return w * EL_BUDDY_WORD_BITS + __builtin_ctzl(*word);
+}
+
+// Set up the buddy allocator to manage the heap of heap_bytes bytes
+// starting at heap. The buddy system only uses the largest power of two
+// bytes that fits in the heap, which starts out as a single free block of
+// the top order. Allocates the free bitmaps for each order and the table
+// of allocated orders. Returns 0 on success or -1 on failure.
+int el_buddy_init(void *heap, size_t heap_bytes) {
+    el_buddy_t *buddy = &el_ctl.buddy;
+    int max_order = EL_BUDDY_MIN_ORDER;
+    while (max_order + 1 < EL_BUDDY_MAX_ORDERS && ((size_t) 1 << (max_order + 1)) <= heap_bytes) {
+        max_order++;
+    }
+    if (((size_t) 1 << max_order) > heap_bytes) {
+        fprintf(stderr,"el_buddy_init: heap size %lu too small for a block of %d bytes\n",
+                heap_bytes, 1 << EL_BUDDY_MIN_ORDER);
+        return -1;
+    }
+
+    size_t words = 0;
+    for (int order = EL_BUDDY_MIN_ORDER; order <= max_order; order++) {
+        size_t blocks = (size_t) 1 << (max_order - order);
+        buddy->word_offset[order] = words;
+        buddy->free_count[order] = 0;
+        words += (blocks + EL_BUDDY_WORD_BITS - 1) / EL_BUDDY_WORD_BITS;
+    }
+    size_t min_blocks = (size_t) 1 << (max_order - EL_BUDDY_MIN_ORDER);
+    buddy->bitmap = calloc(words, sizeof(unsigned long));
+    buddy->alloc_order = malloc(min_blocks);
+    if (buddy->bitmap == NULL || buddy->alloc_order == NULL) {
+        el_buddy_cleanup();
+        return -1;
+    }
+    for (size_t i = 0; i < min_blocks; i++) {
+        buddy->alloc_order[i] = EL_BUDDY_NOT_ALLOCATED;
+    }
+
+    buddy->max_order = max_order;
+    buddy->used_blocks = 0;
+    buddy->used_bytes = 0;
+    el_ctl.heap_start = heap;
+    el_ctl.heap_bytes = heap_bytes;
+    el_ctl.heap_end = PTR_PLUS_BYTES(heap, heap_bytes);
+    el_buddy_set_free(max_order, 0);
+    return 0;
+}
+
+// Release the bitmaps and order table of the buddy allocator.
+void el_buddy_cleanup() {
+    el_buddy_t *buddy = &el_ctl.buddy;
+    free(buddy->bitmap);
+    free(buddy->alloc_order);
+    buddy->bitmap = NULL;
+    buddy->alloc_order = NULL;
+}
+
+// Return the order of the smallest buddy block holding nbytes or -1 if
+// no block is large enough.
+static int el_buddy_order(size_t nbytes) {
+    int order = EL_BUDDY_MIN_ORDER;
+    while (((size_t) 1 << order) < nbytes) {
+        order++;
+        if (order > el_ctl.buddy.max_order) {
+            return -1;
+        }
+    }
+    return order;
+}
+
+// Allocate a block of at least nbytes. Takes the lowest free block of
+// the smallest order with a free block that is large enough and splits
+// it in halves down to the order needed, marking each upper half free.
+// Blocks have no header; the order of the block is recorded in
+// alloc_order for el_buddy_free(). Returns NULL if no block is free.
+void *el_buddy_malloc(size_t nbytes) {
+    el_buddy_t *buddy = &el_ctl.buddy;
+    int order = el_buddy_order(nbytes);
+    if (order < 0) {
+        return NULL;
+    }
+
+    int found = order;
+    while (found <= buddy->max_order && buddy->free_count[found] == 0) {
+        found++;
+    }
+    if (found > buddy->max_order) {
+        return NULL;
+    }
+
+    size_t i = el_buddy_first_free(found);
+    el_buddy_clear_free(found, i);
+    while (found > order) {
+        found--;
+        i = 2 * i;
+        el_buddy_set_free(found, i + 1);
+    }
+
+    void *ptr = PTR_PLUS_BYTES(el_ctl.heap_start, i << order);
+    buddy->alloc_order[(i << order) >> EL_BUDDY_MIN_ORDER] = order;
+    buddy->used_blocks++;
+    buddy->used_bytes += (size_t) 1 << order;
+    return ptr;
+}
+
+// Return the number of usable bytes in the buddy block for ptr.
+size_t el_buddy_usable_size(void *ptr) {
+    size_t offset = PTR_MINUS_PTR(ptr, el_ctl.heap_start);
+    return (size_t) 1 << el_ctl.buddy.alloc_order[offset >> EL_BUDDY_MIN_ORDER];
+}
+
+// Free the block for ptr, merging it with its buddy for as long as the
+// buddy is also free. The buddy of block i of an order is block i^1 so
+// each merge is a single bitmap test.
+void el_buddy_free(void *ptr) {
+    el_buddy_t *buddy = &el_ctl.buddy;
+    size_t offset = PTR_MINUS_PTR(ptr, el_ctl.heap_start);
+    unsigned char *alloc_order = &buddy->alloc_order[offset >> EL_BUDDY_MIN_ORDER];
+    if (*alloc_order == EL_BUDDY_NOT_ALLOCATED) {
+        fprintf(stderr,"el_buddy_free: %p is not an allocated block\n", ptr);
+        return;
+    }
+
+    int order = *alloc_order;
+    *alloc_order = EL_BUDDY_NOT_ALLOCATED;
+    buddy->used_blocks--;
+    buddy->used_bytes -= (size_t) 1 << order;
+
+    size_t i = offset >> order;
+    while (order < buddy->max_order && el_buddy_is_free(order, i ^ 1)) {
+        el_buddy_clear_free(order, i ^ 1);
+        i >>= 1;
+        order++;
+    }
+    el_buddy_set_free(order, i);
+}
+
+// Print out statistics for the buddy allocator in the style of
+// el_print_stats(). The output format resembles the following.
+//
+// HEAP STATS (buddy, min block: 32)
+// heap_start:  0x600000000000
+// heap_end:    0x600000001000
+// total_bytes: 4096
+// FREE BLOCKS BY ORDER:
+//   [ 5] size:    32  free:   1
+//   [ 6] size:    64  free:   0
+//   ...
+//   [12] size:  4096  free:   0
+// USED: {blocks:   3  bytes:   736}
+// FREE: {bytes:  3360}
+void el_buddy_print_stats() {
+    el_buddy_t *buddy = &el_ctl.buddy;
+    printf("HEAP STATS (buddy, min block: %d)\n", 1 << EL_BUDDY_MIN_ORDER);
+    printf("heap_start:  %p\n", el_ctl.heap_start);
+    printf("heap_end:    %p\n", el_ctl.heap_end);
+    printf("total_bytes: %lu\n", el_ctl.heap_bytes);
+    printf("FREE BLOCKS BY ORDER:\n");
+    size_t free_bytes = 0;
+    for (int order = EL_BUDDY_MIN_ORDER; order <= buddy->max_order; order++) {
+        printf("  [%2d] size: %5lu  free: %3lu\n", order, (size_t) 1 << order,
+               buddy->free_count[order]);
+        free_bytes += buddy->free_count[order] << order;
+    }
+    printf("USED: {blocks: %3lu  bytes: %5lu}\n", buddy->used_blocks, buddy->used_bytes);
+    printf("FREE: {bytes: %5lu}\n", free_bytes);
+}
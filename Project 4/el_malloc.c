@@ -1,28 +1,54 @@
 // el_malloc.c: implementation of explicit list allocator functions.
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include "el_malloc.h"
 
 // Global control functions
 
 // Global control variable for the allocator. Must be initialized in
 // el_init().
-el_ctl_t el_ctl = {};
+el_ctl_t el_ctl = {.handle_free = EL_NO_HANDLE};
 
-// Create an initial block of memory for the heap using mmap(). Initialize the
-// el_ctl data structure to point at this block. The initial size/position of
-// the heap for the memory map are given in the symbols EL_HEAP_INITIAL_SIZE
-// and EL_HEAP_START_ADDRESS. Initialize the lists in el_ctl to contain a
-// single large block of available memory and no used blocks of memory.
-int el_init() {
-    void *heap = mmap(EL_HEAP_START_ADDRESS, EL_HEAP_INITIAL_SIZE,
-                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    assert(heap == EL_HEAP_START_ADDRESS);
+#ifdef EL_LATENCY
+// Start timing an operation; pair with EL_TIME_END() in the same scope
+#define EL_TIME_START(var) size_t var = el_now_ns()
+// Record the time since the matching EL_TIME_START() for operation op
+#define EL_TIME_END(op, var) el_histogram_record(&el_ctl.latency.ops[op], el_now_ns() - var)
+// Count n available blocks examined while searching for a fit
+#define EL_COUNT_SCAN(n) (el_scanned += (n))
+static size_t el_now_ns();
+static size_t el_scanned;
+#else
+#define EL_TIME_START(var)
+#define EL_TIME_END(op, var)
+#define EL_COUNT_SCAN(n)
+#endif
+
+static size_t el_release_deferred(long budget_us);
+static void *el_limit_malloc(void *ptr, size_t nbytes);
+static void el_release(void *ptr);
+static void el_coalesce(el_blocklist_t *list, el_blockhead_t *block);
+static void el_quarantine_block(el_blockhead_t *block);
+static void el_trim_quarantine(size_t keep);
 
-    el_ctl.heap_bytes = EL_HEAP_INITIAL_SIZE; // make the heap as big as possible to begin with
+// Initialize the el_ctl data structure for a fresh heap of heap_bytes
+// bytes beginning at heap. Sets the start/end addresses of the heap and
+// initializes the lists in el_ctl to contain a single large block of
+// available memory and no used blocks of memory. Returns 0 on success
+// or -1 if the heap is too small to hold a single block.
+static int el_init_ctl(void *heap, size_t heap_bytes) {
+    el_ctl.heap_bytes = heap_bytes; // make the heap as big as possible to begin with
     el_ctl.heap_start = heap; // set addresses of start and end of heap
     el_ctl.heap_end = PTR_PLUS_BYTES(heap, el_ctl.heap_bytes);
 
@@ -36,6 +62,8 @@ int el_init() {
     el_init_blocklist(&el_ctl.used_actual);
     el_ctl.avail = &el_ctl.avail_actual;
     el_ctl.used = &el_ctl.used_actual;
+    el_ctl.avail_index.count = 0;
+    el_ctl.avail_index.live = 0;
 
     // establish the first available block by filling in size in
     // block/foot and null links in head
@@ -49,11 +77,401 @@ int el_init() {
     return 0;
 }
 
-// Clean up the heap area associated with the system
+// Select the allocator behind el_malloc()/el_free(): EL_BACKEND_LIST
+// (the default) or EL_BACKEND_BUDDY. Must be called while no heap is set
+// up, i.e. before el_init() or after el_cleanup(). Returns 0 on success
+// or -1 if the backend is unknown or a heap exists.
+int el_set_backend(int backend) {
+    if (el_ctl.heap_start != NULL ||
+        (backend != EL_BACKEND_LIST && backend != EL_BACKEND_BUDDY)) {
+        return -1;
+    }
+    el_ctl.backend = backend;
+    return 0;
+}
+
+// Create an initial block of memory for the heap using mmap(). Initialize the
+// el_ctl data structure to point at this block. The initial size/position of
+// the heap for the memory map are given in the symbols EL_HEAP_INITIAL_SIZE
+// and EL_HEAP_START_ADDRESS. Initialize the lists in el_ctl to contain a
+// single large block of available memory and no used blocks of memory, or
+// hand the heap to the buddy backend if it is selected.
+int el_init() {
+    void *heap = mmap(EL_HEAP_START_ADDRESS, EL_HEAP_INITIAL_SIZE,
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(heap == EL_HEAP_START_ADDRESS);
+
+    if (el_ctl.backend == EL_BACKEND_BUDDY) {
+        return el_buddy_init(heap, EL_HEAP_INITIAL_SIZE);
+    }
+    return el_init_ctl(heap, EL_HEAP_INITIAL_SIZE);
+}
+
+// Clean up the heap area associated with the system. A file-backed heap
+// has its header brought up to date before the file is unmapped and
+// closed so that it can be re-opened later with el_open(). Stops the
+// maintenance thread and profiler, removes the limit and its pressure
+// callbacks, disables the quarantine, and drops all other state that
+// refers to blocks in the heap.
 void el_cleanup() {
-    munmap(el_ctl.heap_start, el_ctl.heap_bytes);
+    el_stop_maintenance();
+    if (el_ctl.file_header != NULL) {
+        el_sync();
+        munmap(el_ctl.file_header, EL_FILE_HEADER_BYTES + el_ctl.heap_bytes);
+        close(el_ctl.file_fd);
+        el_ctl.file_header = NULL;
+    }
+    else {
+        munmap(el_ctl.heap_start, el_ctl.heap_bytes);
+    }
+    if (el_ctl.backend == EL_BACKEND_BUDDY) {
+        el_buddy_cleanup();
+    }
     el_ctl.heap_start = NULL;
     el_ctl.heap_end = NULL;
+    el_profile_stop();
+    memset(el_ctl.cache, 0, sizeof(el_ctl.cache));
+    el_ctl.cache_blocks = 0;
+    el_use_avail_index(0);
+    free(el_ctl.handles);
+    el_ctl.handles = NULL;
+    el_ctl.handle_count = 0;
+    el_ctl.handle_free = EL_NO_HANDLE;
+    memset(&el_ctl.limit, 0, sizeof(el_ctl.limit));
+    memset(&el_ctl.quarantine, 0, sizeof(el_ctl.quarantine));
+}
+
+// Locking for threads
+
+static pthread_once_t el_lock_once = PTHREAD_ONCE_INIT;
+
+// Initialize the recursive lock in el_ctl; run once by el_enable_locking()
+static void el_init_lock() {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&el_ctl.lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+// Make every allocator operation take the lock in el_ctl so that the
+// private heap may be used from several threads. Locking stays on once
+// enabled. Called when the maintenance thread is started.
+void el_enable_locking() {
+    pthread_once(&el_lock_once, el_init_lock);
+    el_ctl.threaded = 1;
+}
+
+// Take the allocator lock if locking is enabled. The lock is recursive
+// as public operations call each other, e.g. el_malloc() flushing the
+// size-class cache.
+static void el_lock() {
+    if (el_ctl.threaded) {
+        pthread_mutex_lock(&el_ctl.lock);
+    }
+}
+
+// Release the allocator lock taken by el_lock()
+static void el_unlock() {
+    if (el_ctl.threaded) {
+        pthread_mutex_unlock(&el_ctl.lock);
+    }
+}
+
+// File-backed heap functions
+
+// Record the state of list in saved. The first/last blocks are stored
+// as offsets from heap_start as the links to the dummy nodes in el_ctl
+// are meaningless in another run.
+static void el_save_blocklist(el_filelist_t *saved, el_blocklist_t *list) {
+    if (list->length == 0) {
+        saved->first = EL_NO_OFFSET;
+        saved->last = EL_NO_OFFSET;
+    }
+    else {
+        saved->first = PTR_MINUS_PTR(list->beg->next, el_ctl.heap_start);
+        saved->last = PTR_MINUS_PTR(list->end->prev, el_ctl.heap_start);
+    }
+    saved->length = list->length;
+    saved->bytes = list->bytes;
+}
+
+// Restore list from the state recorded in saved by re-linking the
+// dummy beg/end nodes of the list with its first/last blocks. Blocks in
+// the middle of the list are not touched.
+static void el_load_blocklist(el_blocklist_t *list, el_filelist_t *saved) {
+    el_init_blocklist(list);
+    if (saved->first != EL_NO_OFFSET) {
+        el_blockhead_t *first = PTR_PLUS_BYTES(el_ctl.heap_start, saved->first);
+        el_blockhead_t *last = PTR_PLUS_BYTES(el_ctl.heap_start, saved->last);
+        list->beg->next = first;
+        first->prev = list->beg;
+        list->end->prev = last;
+        last->next = list->end;
+    }
+    list->length = saved->length;
+    list->bytes = saved->bytes;
+}
+
+// Copy the el_ctl state into the header of the heap file. Does nothing
+// if the heap is not file-backed.
+static void el_save_header() {
+    el_fileheader_t *header = el_ctl.file_header;
+    if (header == NULL) {
+        return;
+    }
+    header->heap_bytes = el_ctl.heap_bytes;
+    el_save_blocklist(&header->avail, el_ctl.avail);
+    el_save_blocklist(&header->used, el_ctl.used);
+}
+
+// Copy the state recorded in the header of the heap file into el_ctl.
+// Another process sharing the heap may have changed the lists since this
+// process last touched them so this is done on every entry to the
+// allocator.
+static void el_load_header() {
+    el_fileheader_t *header = el_ctl.file_header;
+    el_ctl.heap_bytes = header->heap_bytes;
+    el_ctl.heap_start = PTR_PLUS_BYTES(header, EL_FILE_HEADER_BYTES);
+    el_ctl.heap_end = PTR_PLUS_BYTES(el_ctl.heap_start, el_ctl.heap_bytes);
+    el_load_blocklist(&el_ctl.avail_actual, &header->avail);
+    el_load_blocklist(&el_ctl.used_actual, &header->used);
+    el_ctl.avail = &el_ctl.avail_actual;
+    el_ctl.used = &el_ctl.used_actual;
+}
+
+// Rebuild both lists of a file-backed heap by walking its blocks in
+// memory order using their boundary tags, ignoring the next/prev links
+// and the list ends saved in the header. Used after a process died in
+// the middle of an operation, which can leave the links torn. Returns
+// -1 without touching the lists if the tags themselves are inconsistent,
+// as when the process died while splitting or merging a block; 0
+// otherwise.
+static int el_rebuild_lists() {
+    el_fileheader_t *header = el_ctl.file_header;
+    void *heap_start = PTR_PLUS_BYTES(header, EL_FILE_HEADER_BYTES);
+    void *heap_end = PTR_PLUS_BYTES(heap_start, header->heap_bytes);
+    el_blockhead_t *block = heap_start;
+    while ((void *) block < heap_end) {
+        size_t room = PTR_MINUS_PTR(heap_end, block);
+        if (room < EL_BLOCK_OVERHEAD || block->size > room - EL_BLOCK_OVERHEAD ||
+            el_get_footer(block)->size != block->size ||
+            (block->state != EL_AVAILABLE && block->state != EL_USED)) {
+            return -1;
+        }
+        block = PTR_PLUS_BYTES(block, block->size + EL_BLOCK_OVERHEAD);
+    }
+
+    el_ctl.heap_bytes = header->heap_bytes;
+    el_ctl.heap_start = heap_start;
+    el_ctl.heap_end = heap_end;
+    el_init_blocklist(&el_ctl.avail_actual);
+    el_init_blocklist(&el_ctl.used_actual);
+    el_ctl.avail = &el_ctl.avail_actual;
+    el_ctl.used = &el_ctl.used_actual;
+    for (block = heap_start; (void *) block < heap_end;
+         block = PTR_PLUS_BYTES(block, block->size + EL_BLOCK_OVERHEAD)) {
+        el_add_block_front(block->state == EL_AVAILABLE ? el_ctl.avail : el_ctl.used, block);
+    }
+    el_save_header();
+    return 0;
+}
+
+// Called at the start of every allocator operation. For a file-backed
+// heap, which may be mapped by several processes, takes the
+// process-shared lock in the header and loads the current list state
+// from it. Only the ends of the lists are kept in the header while the
+// links between blocks are changed in place, so if the previous owner of
+// the lock died mid-operation the lists are rebuilt from the boundary
+// tags with el_rebuild_lists(). If the tags are torn too, the heap is
+// marked unusable in the header and every later operation on it, in any
+// process, fails. Returns 0 with the lock held, or -1 without it if the
+// heap is unusable. Does nothing and returns 0 for a private heap.
+static int el_enter() {
+    el_fileheader_t *header = el_ctl.file_header;
+    if (header == NULL) {
+        return 0;
+    }
+    if (pthread_mutex_lock(&header->lock) == EOWNERDEAD) {
+        fprintf(stderr,"el_enter: previous owner of heap lock died\n");
+        if (!header->unusable && el_rebuild_lists() != 0) {
+            fprintf(stderr,"el_enter: heap blocks left torn, heap is unusable\n");
+            header->unusable = 1;
+        }
+        pthread_mutex_consistent(&header->lock);
+    }
+    if (header->unusable) {
+        pthread_mutex_unlock(&header->lock);
+        return -1;
+    }
+    el_load_header();
+    return 0;
+}
+
+// Called at the end of every allocator operation to undo el_enter():
+// saves the list ends back to the header for the next process to load
+// and releases the lock.
+static void el_leave() {
+    el_fileheader_t *header = el_ctl.file_header;
+    if (header == NULL) {
+        return;
+    }
+    el_save_header();
+    pthread_mutex_unlock(&header->lock);
+}
+
+// Map the heap file open as fd at the fixed address used by all heaps
+// and set up el_ctl to use it. If the file is empty it is sized to hold
+// a fresh heap of heap_bytes bytes which is initialized along with the
+// header; otherwise the header is checked and the el_ctl state restored
+// from it. The file is flock()'d while this happens so that processes
+// opening the same file at the same time agree on who creates it. name
+// is only used for error messages. On failure fd is closed and -1 is
+// returned; 0 is returned on success.
+static int el_map_heap(int fd, const char *name, size_t heap_bytes) {
+    if (el_ctl.backend != EL_BACKEND_LIST) {
+        fprintf(stderr,"el_open: file-backed heaps require the list backend\n");
+        close(fd);
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) < 0) {
+        fprintf(stderr,"el_open: couldn't lock %s\n", name);
+        close(fd);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr,"el_open: couldn't stat %s\n", name);
+        close(fd);
+        return -1;
+    }
+
+    int fresh = (st.st_size == 0);
+    size_t file_bytes = fresh ? EL_FILE_HEADER_BYTES + heap_bytes : (size_t) st.st_size;
+    if (file_bytes <= EL_FILE_HEADER_BYTES) {
+        fprintf(stderr,"el_open: %s is too small to be a heap file\n", name);
+        close(fd);
+        return -1;
+    }
+    if (fresh && ftruncate(fd, file_bytes) < 0) {
+        fprintf(stderr,"el_open: couldn't size %s to %lu bytes\n", name, file_bytes);
+        close(fd);
+        return -1;
+    }
+
+    void *addr = PTR_MINUS_BYTES(EL_HEAP_START_ADDRESS, EL_FILE_HEADER_BYTES);
+    void *base = mmap(addr, file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base != addr) {
+        fprintf(stderr,"el_open: couldn't map %s at %p\n", name, addr);
+        if (base != MAP_FAILED) {
+            munmap(base, file_bytes);
+        }
+        close(fd);
+        return -1;
+    }
+
+    el_fileheader_t *header = base;
+    void *heap = PTR_PLUS_BYTES(base, EL_FILE_HEADER_BYTES);
+    if (fresh) {
+        if (el_init_ctl(heap, file_bytes - EL_FILE_HEADER_BYTES) != 0) {
+            munmap(base, file_bytes);
+            close(fd);
+            return -1;
+        }
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        memcpy(header->magic, EL_FILE_MAGIC, sizeof(header->magic));
+        el_ctl.file_header = header;
+        el_save_header();
+    }
+    else {
+        if (memcmp(header->magic, EL_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->heap_bytes != file_bytes - EL_FILE_HEADER_BYTES) {
+            fprintf(stderr,"el_open: %s is not a heap file\n", name);
+            munmap(base, file_bytes);
+            close(fd);
+            return -1;
+        }
+        el_ctl.file_header = header;
+        el_load_header();
+    }
+
+    el_ctl.file_fd = fd;
+    flock(fd, LOCK_UN);
+    return 0;
+}
+
+// Open the heap stored in the file at path for use in place of el_init().
+// If the file does not exist or is empty it is created with a fresh heap
+// of EL_HEAP_INITIAL_SIZE bytes. The file is mapped with MAP_SHARED so
+// changes to blocks go straight to the file. The first EL_FILE_HEADER_BYTES
+// of the file hold the el_fileheader_t and are mapped just below
+// EL_HEAP_START_ADDRESS so the heap itself is always at the same address;
+// restoring the heap only re-links the list ends so it takes the same
+// time regardless of how much data is in the heap. Returns 0 on success
+// or -1 on failure.
+int el_open(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr,"el_open: couldn't open %s\n", path);
+        return -1;
+    }
+    return el_map_heap(fd, path, EL_HEAP_INITIAL_SIZE);
+}
+
+// Open the heap in the POSIX shared memory object with the given name
+// (which should begin with a '/') for use in place of el_init(). The
+// object is created with room for heap_bytes bytes of heap if it does not
+// exist yet; otherwise heap_bytes is ignored. Every process that opens
+// the same name sees the same heap at the same address: blocks
+// el_malloc()'d in one process may be passed to another, usually as an
+// offset from el_ptr_to_offset(), and el_free()'d there. Operations are
+// serialized by a process-shared lock in the header. The object remains
+// after el_cleanup() until it is removed with shm_unlink(). Returns 0 on
+// success or -1 on failure.
+int el_shm_open(const char *name, size_t heap_bytes) {
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        fprintf(stderr,"el_shm_open: couldn't open %s\n", name);
+        return -1;
+    }
+    return el_map_heap(fd, name, heap_bytes);
+}
+
+// Convert a pointer into the heap to an offset from heap_start. Offsets
+// rather than pointers should be used when handing blocks to another
+// process sharing the heap.
+long el_ptr_to_offset(void *ptr) {
+    return PTR_MINUS_PTR(ptr, el_ctl.heap_start);
+}
+
+// Convert an offset from el_ptr_to_offset() back into a pointer in this
+// process.
+void *el_offset_to_ptr(long offset) {
+    return PTR_PLUS_BYTES(el_ctl.heap_start, offset);
+}
+
+// Bring the header of a file-backed heap up to date and flush the whole
+// mapping to the file. Returns 0 on success or -1 if the heap is not
+// file-backed or the flush fails.
+int el_sync() {
+    if (el_ctl.file_header == NULL) {
+        return -1;
+    }
+    if (el_enter() != 0) {
+        return -1;
+    }
+    el_leave();
+    if (msync(el_ctl.file_header, EL_FILE_HEADER_BYTES + el_ctl.heap_bytes, MS_SYNC) < 0) {
+        fprintf(stderr,"el_sync: msync failed\n");
+        return -1;
+    }
+    return 0;
 }
 
 // Pointer arithmetic functions to access adjacent headers/footers
@@ -140,6 +558,22 @@ void el_print_blocklist(el_blocklist_t *list) {
     }
 }
 
+// Print the number of blocks parked in each non-empty bin of the
+// size-class cache. The format appears as follows.
+//
+// SIZE CACHE: {blocks:   3}
+//   [  8] count:   2  (64-71 bytes)
+//   [ 16] count:   1  (128-135 bytes)
+void el_print_cache() {
+    printf("SIZE CACHE: {blocks: %3lu}\n", el_ctl.cache_blocks);
+    for (int bin = 0; bin < EL_CACHE_CLASSES; bin++) {
+        if (el_ctl.cache[bin].count > 0) {
+            printf("  [%3d] count: %3lu  (%d-%d bytes)\n", bin, el_ctl.cache[bin].count,
+                   bin * EL_CACHE_GRANULE, (bin + 1) * EL_CACHE_GRANULE - 1);
+        }
+    }
+}
+
 // Print out basic heap statistics. This shows total heap info along
 // with the Available and Used Lists. The output format resembles the following.
 //
@@ -159,7 +593,30 @@ void el_print_blocklist(el_blocklist_t *list) {
 //         foot @ 0x6000000001f8 {size:    64}
 //   [  2] head @ 0x6000000000a8 {state: u  size:   200}
 //         foot @ 0x600000000190 {size:   200}
+//
+// If blocks are parked in the size-class cache they are shown after the
+// lists using el_print_cache(). The buddy backend prints its own stats
+// with el_buddy_print_stats().
 void el_print_stats() {
+    el_lock();
+    if (el_ctl.backend == EL_BACKEND_BUDDY) {
+        el_buddy_print_stats();
+        if (el_ctl.cache_blocks > 0) {
+            el_print_cache();
+        }
+        if (el_ctl.limit.bytes > 0) {
+            el_print_limit();
+        }
+#ifdef EL_LATENCY
+        el_print_latency();
+#endif
+        el_unlock();
+        return;
+    }
+    if (el_enter() != 0) {
+        el_unlock();
+        return;
+    }
     printf("HEAP STATS (overhead per node: %lu)\n", EL_BLOCK_OVERHEAD);
     printf("heap_start:  %p\n", el_ctl.heap_start);
     printf("heap_end:    %p\n", el_ctl.heap_end);
@@ -168,6 +625,135 @@ void el_print_stats() {
     el_print_blocklist(el_ctl.avail);
     printf("USED LIST: ");
     el_print_blocklist(el_ctl.used);
+    if (el_ctl.quarantine.budget > 0) {
+        el_print_quarantine();
+    }
+    if (el_ctl.cache_blocks > 0) {
+        el_print_cache();
+    }
+    if (el_ctl.limit.bytes > 0) {
+        el_print_limit();
+    }
+#ifdef EL_LATENCY
+    el_print_latency();
+#endif
+    el_leave();
+    el_unlock();
+}
+
+// Available index functions
+
+// Squeeze removed slots out of the available index, keeping the live
+// blocks in the same order and updating the slot recorded in each.
+static void el_index_compact() {
+    el_availindex_t *ai = &el_ctl.avail_index;
+    size_t live = 0;
+    for (size_t i = 0; i < ai->count; i++) {
+        if (ai->blocks[i] != NULL) {
+            ai->sizes[live] = ai->sizes[i];
+            ai->blocks[live] = ai->blocks[i];
+            ai->blocks[live]->index = live;
+            live++;
+        }
+    }
+    ai->count = live;
+}
+
+// Record block in the next slot of the available index, making room by
+// compacting or growing the table if needed. If the table cannot grow
+// the index is switched off; searches then walk the list as usual.
+static void el_index_append(el_blockhead_t *block) {
+    el_availindex_t *ai = &el_ctl.avail_index;
+    if (ai->count == ai->capacity && ai->live <= ai->count / 2) {
+        el_index_compact();
+    }
+    if (ai->count == ai->capacity) {
+        size_t capacity = ai->capacity == 0 ? 64 : 2 * ai->capacity;
+        size_t *sizes = realloc(ai->sizes, capacity * sizeof(size_t));
+        el_blockhead_t **blocks = sizes == NULL ? NULL :
+            realloc(ai->blocks, capacity * sizeof(el_blockhead_t *));
+        if (blocks == NULL) {
+            ai->sizes = sizes != NULL ? sizes : ai->sizes;
+            el_use_avail_index(0);
+            return;
+        }
+        ai->sizes = sizes;
+        ai->blocks = blocks;
+        ai->capacity = capacity;
+    }
+    block->index = ai->count;
+    ai->sizes[ai->count] = block->size;
+    ai->blocks[ai->count] = block;
+    ai->count++;
+    ai->live++;
+}
+
+// Empty the slot of block in the available index.
+static void el_index_remove(el_blockhead_t *block) {
+    el_availindex_t *ai = &el_ctl.avail_index;
+    ai->sizes[block->index] = 0;
+    ai->blocks[block->index] = NULL;
+    ai->live--;
+}
+
+// Return the block in the available index that el_find_first_avail()
+// would find by walking the list: the one nearest the end of the table
+// with a size of at least need. Slots are checked a group at a time
+// without an early exit so the comparisons can be vectorized.
+static el_blockhead_t *el_index_find(size_t need) {
+    el_availindex_t *ai = &el_ctl.avail_index;
+    const size_t group = 8;
+    size_t end = ai->count;
+    while (end > 0) {
+        size_t start = end > group ? end - group : 0;
+        int any = 0;
+        for (size_t i = start; i < end; i++) {
+            any |= ai->sizes[i] >= need;
+        }
+        EL_COUNT_SCAN(end - start);
+        if (any) {
+            for (size_t i = end; i-- > start; ) {
+                if (ai->sizes[i] >= need) {
+                    return ai->blocks[i];
+                }
+            }
+        }
+        end = start;
+    }
+    return NULL;
+}
+
+// Switch the available index on or off. Turning it on builds the table
+// from the current available list. The index is private to the process
+// so it cannot be used with file-backed heaps. Returns 0 on success or
+// -1 if the index cannot be enabled.
+int el_use_avail_index(int enable) {
+    el_availindex_t *ai = &el_ctl.avail_index;
+    free(ai->sizes);
+    free(ai->blocks);
+    ai->sizes = NULL;
+    ai->blocks = NULL;
+    ai->count = 0;
+    ai->live = 0;
+    ai->capacity = 0;
+    ai->enabled = 0;
+    if (!enable) {
+        return 0;
+    }
+    if (el_ctl.file_header != NULL || el_ctl.backend != EL_BACKEND_LIST) {
+        fprintf(stderr,"el_use_avail_index: only supported for private list heaps\n");
+        return -1;
+    }
+
+    ai->enabled = 1;
+    if (el_ctl.avail != NULL) {
+        // append from the back of the list so the front ends up last
+        for (el_blockhead_t *block = el_ctl.avail->end->prev;
+             block != el_ctl.avail->beg && ai->enabled; block = block->prev) {
+            el_index_append(block);
+        }
+    }
+    return ai->enabled ? 0 : -1;
 }
 
 // Initialize the specified list to be empty. Sets the beg/end
@@ -190,8 +776,18 @@ void el_init_blocklist(el_blocklist_t *list) {
 
 // Add to the front of list; links for block are adjusted as are links
 // within list. Length is incremented and the bytes for the list are
-// updated to include the new block's size and its overhead.
+// updated to include the new block's size and its overhead. Blocks added
+// to the available list have their maintenance flags cleared, as they
+// are newly freed, split or merged, and are also recorded in the
+// available index when it is enabled.
 void el_add_block_front(el_blocklist_t *list, el_blockhead_t *block) {
+    if (list == el_ctl.avail) {
+        block->flags = 0;
+        if (el_ctl.avail_index.enabled) {
+            el_index_append(block);
+        }
+    }
+
     // Adjust the links for the new block
     block->next = list->beg->next;
     block->prev = list->beg;
@@ -216,10 +812,16 @@ void el_add_block_front(el_blocklist_t *list, el_blockhead_t *block) {
 
 // Unlink block from the specified list.
 // Updates the length and bytes for that list including
-// the EL_BLOCK_OVERHEAD bytes associated with header/footer.
+// the EL_BLOCK_OVERHEAD bytes associated with header/footer. Blocks
+// removed from the available list are also dropped from the available
+// index when it is enabled.
 void el_remove_block(el_blocklist_t *list, el_blockhead_t *block) {
     // Check if the block exists in the specified list
     if (block != NULL && block != list->end) {
+        if (list == el_ctl.avail && el_ctl.avail_index.enabled) {
+            el_index_remove(block);
+        }
+
         // Adjust links to remove the block from the list
         block->prev->next = block->next;
         block->next->prev = block->prev;
@@ -239,14 +841,15 @@ void el_remove_block(el_blocklist_t *list, el_blockhead_t *block) {
 
 // Allocation-related functions
 
-// Find the first block in the available list with block size of at
-// least (size + EL_BLOCK_OVERHEAD). Overhead is accounted for so this
-// routine may be used to find an available block to split: splitting
-// requires adding in a new header/footer. Returns a pointer to the
-// found block or NULL if no of sufficient size is available.
-el_blockhead_t *el_find_first_avail(size_t size) {
+// Search for the first fit for el_find_first_avail(), counting the
+// available blocks examined when EL_LATENCY is defined.
+static el_blockhead_t *el_find_first_fit(size_t size) {
+    if (el_ctl.avail_index.enabled) {
+        return el_index_find(size + EL_BLOCK_OVERHEAD);
+    }
     el_blockhead_t *block = el_ctl.avail->beg->next;
     while (block != el_ctl.avail->end) {
+        EL_COUNT_SCAN(1);
         if (block->size >= size + EL_BLOCK_OVERHEAD) {
             return block;
         }
@@ -255,6 +858,25 @@ el_blockhead_t *el_find_first_avail(size_t size) {
     return NULL;
 }
 
+// Find the first block in the available list with block size of at
+// least (size + EL_BLOCK_OVERHEAD). Overhead is accounted for so this
+// routine may be used to find an available block to split: splitting
+// requires adding in a new header/footer. Returns a pointer to the
+// found block or NULL if no of sufficient size is available. When the
+// available index is enabled, the search scans its table of sizes
+// instead of the list and finds the same block. When EL_LATENCY is
+// defined the number of blocks examined is added to the scan histogram.
+el_blockhead_t *el_find_first_avail(size_t size) {
+#ifdef EL_LATENCY
+    el_scanned = 0;
+    el_blockhead_t *found = el_find_first_fit(size);
+    el_histogram_record(&el_ctl.latency.scan, el_scanned);
+    return found;
+#else
+    return el_find_first_fit(size);
+#endif
+}
+
 // Set the pointed-to block to the given size and add a footer to it. This function
 // creates another block above it by creating a new header and assigning it the
 // remaining space. It ensures that the new block has a footer with the correct size.
@@ -289,37 +911,215 @@ el_blockhead_t *el_split_block(el_blockhead_t *block, size_t new_size) {
     return newBlock;
 }
 
-// Return a pointer to a block of memory with at least the given size
-// for use by the user. The pointer returned is to the usable space,
-// not the block header. This function uses el_find_first_avail() to
-// locate a suitable block and el_split_block() to split it if possible
-// to fulfill the allocation request. If no space is available, it returns NULL.
-void *el_malloc(size_t nbytes) {
-    // Find an available block that can accommodate nbytes + overhead
-    el_blockhead_t *block = el_find_first_avail(nbytes);
+// Remove and return a block parked in the size-class cache that is large
+// enough for nbytes or NULL if the cache has no such block. Blocks in bin
+// b are at least b*EL_CACHE_GRANULE bytes so a request is served from
+// the bin for its size rounded up.
+static void *el_cache_pop(size_t nbytes) {
+    size_t bin = (nbytes + EL_CACHE_GRANULE - 1) / EL_CACHE_GRANULE;
+    if (bin >= EL_CACHE_CLASSES || el_ctl.cache[bin].head == NULL) {
+        return NULL;
+    }
+    el_cachebin_t *cbin = &el_ctl.cache[bin];
+    void *ptr = cbin->head;
+    cbin->head = *(void **) ptr;
+    cbin->count--;
+    el_ctl.cache_blocks--;
+    return ptr;
+}
+
+// Find a block in the available list with room for size bytes using
+// el_find_first_avail(), split it with el_split_block() if possible and
+// move it to the used list. If the block is too small to split, the whole
+// block is used and the extra bytes are reported by
+// el_malloc_usable_size(). Returns the allocated block or NULL if no
+// available block is large enough.
+el_blockhead_t *el_allocate_block(size_t size) {
+    if (el_enter() != 0) {
+        return NULL;
+    }
+
+    // Find an available block that can accommodate size + overhead
+    el_blockhead_t *block = el_find_first_avail(size);
 
     if (block != NULL) {
         // Remove the original block from avaliable
         el_remove_block(el_ctl.avail, block);
 
         // Attempt to split the block to fulfill the allocation request
-        el_blockhead_t *splitBlock = el_split_block(block, nbytes);
+        el_blockhead_t *splitBlock = el_split_block(block, size);
 
         if (splitBlock != NULL) {
             //change states of splitBlock and block
             splitBlock->state = EL_AVAILABLE;
-            block->state = EL_USED;
 
-            // add the split block to used and the block back to avail
+            // add the split block back to avail
             el_add_block_front(el_ctl.avail, splitBlock); 
-            el_add_block_front(el_ctl.used, block); 
-            
-            // Return the usable memory address within the split block
-            return PTR_PLUS_BYTES(block, sizeof(el_blockhead_t));
         }
+
+        // add the block to used
+        block->state = EL_USED;
+        el_add_block_front(el_ctl.used, block); 
     }
 
-    return NULL; // Indicates failure to allocate
+    el_leave();
+    return block;
+}
+
+// Allocate nbytes from the selected backend, returning the usable space
+// or NULL on failure.
+static void *el_backend_malloc(size_t nbytes) {
+    if (el_ctl.backend == EL_BACKEND_BUDDY) {
+        return el_buddy_malloc(nbytes);
+    }
+    el_blockhead_t *block = el_allocate_block(nbytes);
+    if (block == NULL) {
+        return NULL;
+    }
+    return PTR_PLUS_BYTES(block, sizeof(el_blockhead_t));
+}
+
+// Return a pointer to a block of memory with at least the given size
+// for use by the user. The pointer returned is to the usable space,
+// not the block header. Small requests are first served from blocks
+// parked in the size-class cache by el_free_sized(). Otherwise the
+// block comes from the selected backend, el_allocate_block() for the
+// list allocator. If no space is available, the cache is flushed to let
+// its blocks coalesce, along with any frees deferred by the maintenance
+// thread and blocks in quarantine, and the allocation is retried once.
+// When a limit is set with el_set_limit(), el_limit_malloc() then runs
+// the pressure callbacks and grows the heap before giving up. Successful
+// allocations are reported to the sampling profiler when it is running.
+void *el_malloc(size_t nbytes) {
+    el_lock();
+    EL_TIME_START(malloc_start);
+    void *ptr = el_cache_pop(nbytes);
+    if (ptr == NULL) {
+        ptr = el_backend_malloc(nbytes);
+    }
+    if (ptr == NULL && (el_ctl.cache_blocks > 0 || el_ctl.deferred_count > 0 ||
+                        (el_ctl.quarantine.list != NULL && el_ctl.quarantine.list->length > 0))) {
+        // parked, deferred and quarantined blocks may coalesce with their
+        // neighbours into a block large enough for the request
+        el_flush_cache();
+        el_release_deferred(0);
+        el_flush_quarantine();
+        ptr = el_backend_malloc(nbytes);
+    }
+    if (el_ctl.limit.bytes > 0 && !el_ctl.limit.in_pressure) {
+        ptr = el_limit_malloc(ptr, nbytes);
+    }
+    if (ptr != NULL && el_ctl.profile != NULL) {
+        el_profile_malloc(ptr, nbytes);
+    }
+    EL_TIME_END(EL_LAT_MALLOC, malloc_start);
+    el_unlock();
+    return ptr; // NULL indicates failure to allocate
+}
+
+// Return the number of usable bytes in the block for ptr, which was
+// returned by el_malloc(). This is at least the size requested and may
+// be more when el_split_block() declined to split the block; callers may
+// use all of it. Returns 0 for NULL.
+size_t el_malloc_usable_size(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    if (el_ctl.backend == EL_BACKEND_BUDDY) {
+        return el_buddy_usable_size(ptr);
+    }
+    el_blockhead_t *block = PTR_MINUS_BYTES(ptr, sizeof(el_blockhead_t));
+    return block->size;
+}
+
+// Place an aligned payload of rounded bytes in the used block at ptr,
+// which has room for alignment plus a whole extra block beyond rounded.
+// The aligned payload gets its own header, and the space below it and
+// beyond rounded are split off as blocks of their own and freed at once.
+// Returns the aligned payload or NULL, after freeing ptr, if the heap is
+// unusable.
+static void *el_align_block(void *ptr, size_t alignment, size_t rounded) {
+    if (el_enter() != 0) {
+        el_release(ptr);
+        return NULL;
+    }
+    size_t addr = (size_t) ptr + EL_BLOCK_OVERHEAD;
+    void *aligned = (void *) ((addr + alignment - 1) & ~(alignment - 1));
+    if ((size_t) ptr % alignment == 0) {
+        aligned = ptr;
+    }
+    el_blockhead_t *lower = PTR_MINUS_BYTES(ptr, sizeof(el_blockhead_t));
+    el_blockhead_t *upper = PTR_MINUS_BYTES(aligned, sizeof(el_blockhead_t));
+    if (aligned != ptr) {
+        // split off the space below aligned as a block of its own
+        size_t gap = PTR_MINUS_PTR(aligned, ptr);
+        el_remove_block(el_ctl.used, lower);
+        upper->size = lower->size - gap;
+        upper->state = EL_USED;
+        el_get_footer(upper)->size = upper->size;
+        lower->size = gap - EL_BLOCK_OVERHEAD;
+        el_get_footer(lower)->size = lower->size;
+        el_add_block_front(el_ctl.used, lower);
+        el_add_block_front(el_ctl.used, upper);
+    }
+    // and the space beyond the request, if there is room for a block
+    el_remove_block(el_ctl.used, upper);
+    el_blockhead_t *tail = el_split_block(upper, rounded);
+    el_add_block_front(el_ctl.used, upper);
+    if (tail != NULL) {
+        tail->state = EL_USED;
+        el_add_block_front(el_ctl.used, tail);
+    }
+    el_leave();
+    if (aligned != ptr) {
+        el_release(ptr);
+    }
+    if (tail != NULL) {
+        el_release(PTR_PLUS_BYTES(tail, sizeof(el_blockhead_t)));
+    }
+    return aligned;
+}
+
+// Return a pointer to at least nbytes of usable space aligned to
+// alignment, which must be a power of two; alignments below 8 are raised
+// to 8. Buddy blocks are aligned to their own size so a block of at least
+// alignment bytes is used. The list allocator keeps block sizes exact so
+// its blocks may start at any byte. A plain block for nbytes, rounded up
+// to 8, is tried first and kept if it happens to be aligned, as it is
+// when every request on the heap is a multiple of 8. Otherwise it is
+// freed and a larger block is trimmed to the aligned payload with
+// el_align_block(). Either way the result may be passed to el_free()
+// like any other. Returns NULL on failure.
+void *el_aligned_alloc(size_t alignment, size_t nbytes) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        fprintf(stderr,"el_aligned_alloc: alignment %lu is not a power of two\n", alignment);
+        return NULL;
+    }
+    if (alignment < 8) {
+        alignment = 8;
+    }
+    if (el_ctl.backend == EL_BACKEND_BUDDY) {
+        return el_malloc(nbytes > alignment ? nbytes : alignment);
+    }
+
+    el_lock();
+    struct el_profile *profile = el_ctl.profile; // report only the aligned block
+    el_ctl.profile = NULL;
+    size_t rounded = (nbytes + 7) & ~(size_t) 7; // keep the block after this one aligned
+    void *ptr = el_malloc(rounded);
+    if (ptr != NULL && (size_t) ptr % alignment != 0) {
+        el_release(ptr);
+        ptr = el_malloc(rounded + alignment + EL_BLOCK_OVERHEAD);
+        if (ptr != NULL) {
+            ptr = el_align_block(ptr, alignment, rounded);
+        }
+    }
+    el_ctl.profile = profile;
+    if (ptr != NULL && el_ctl.profile != NULL) {
+        el_profile_malloc(ptr, nbytes);
+    }
+    el_unlock();
+    return ptr;
 }
 
 // De-allocation/free() related functions
@@ -344,6 +1144,7 @@ void el_merge_block_with_above(el_blockhead_t *lower) {
     if (higher == NULL || higher->state != EL_AVAILABLE) {
         return;
     }
+    EL_TIME_START(merge_start);
 
     // Remove both blocks from the available list
     el_remove_block(el_ctl.avail, lower);
@@ -377,6 +1178,7 @@ void el_merge_block_with_above(el_blockhead_t *lower) {
         // Add the merged block back to the available list
         el_add_block_front(el_ctl.avail, higher);
     }
+    EL_TIME_END(EL_LAT_MERGE, merge_start);
 }
 
 
@@ -385,19 +1187,36 @@ void el_merge_block_with_above(el_blockhead_t *lower) {
 // preceding the pointer should contain an el_blockhead_t with information
 // on the block size. This function attempts to merge the freed block with adjacent
 // blocks using el_merge_block_with_above() to consolidate memory space.
-void el_free(void *ptr) {
-    if (ptr == NULL) {
+// This does the work of el_free() once any deferral is over.
+static void el_release(void *ptr) {
+    if (el_ctl.backend == EL_BACKEND_BUDDY) {
+        el_buddy_free(ptr);
+        return;
+    }
+
+    if (el_enter() != 0) {
         return;
     }
 
     // Calculate the block address by adjusting the pointer
     el_blockhead_t *block = PTR_MINUS_BYTES(ptr, sizeof(el_blockhead_t));
+    if (el_ctl.quarantine.budget > 0) {
+        el_quarantine_block(block);
+    }
+    else {
+        el_coalesce(el_ctl.used, block);
+    }
+    el_leave();
+}
 
+// Move block from list to the available list and merge it with the
+// blocks above and below it in memory if they are available.
+static void el_coalesce(el_blocklist_t *list, el_blockhead_t *block) {
     // Change the block state to available
     block->state = EL_AVAILABLE;
 
-    // Remove the block from the used list
-    el_remove_block(el_ctl.used, block);
+    // Remove the block from its list
+    el_remove_block(list, block);
 
     // Add the block back to the available list
     el_add_block_front(el_ctl.avail, block);
@@ -413,6 +1232,806 @@ void el_free(void *ptr) {
     if (block_below != NULL && block_below->state == EL_AVAILABLE) {
         el_merge_block_with_above(block_below);
     }
+}
 
-    
+// Free the block pointed to by the given ptr which was returned by
+// el_malloc(). The block is merged with its neighbours by el_release().
+// While the maintenance thread is running the block is instead pushed on
+// the list of deferred frees, linked through its payload, and the thread
+// releases it later so that el_free() itself stays short.
+void el_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    el_lock();
+    EL_TIME_START(free_start);
+    if (el_ctl.profile != NULL) {
+        el_profile_free(ptr);
+    }
+    if (el_ctl.quarantine.budget > 0 &&
+        ((el_blockhead_t *) PTR_MINUS_BYTES(ptr, sizeof(el_blockhead_t)))->state == EL_QUARANTINED) {
+        fprintf(stderr,"el_free: double free of %p\n", ptr);
+        el_ctl.quarantine.double_frees++;
+    }
+    else if (el_ctl.maint.running && el_malloc_usable_size(ptr) >= sizeof(void *)) {
+        *(void **) ptr = el_ctl.deferred;
+        el_ctl.deferred = ptr;
+        el_ctl.deferred_count++;
+    }
+    else {
+        el_release(ptr);
+    }
+    EL_TIME_END(EL_LAT_FREE, free_start);
+    el_unlock();
+}
+
+// Free the block for ptr, which the caller knows to have been allocated
+// with a size of at least size bytes. Small blocks are parked in the bin
+// of the size-class cache for size without reading the block header or
+// touching the neighbouring blocks or lists; el_malloc() hands them back
+// out directly. Parked blocks stay in the used list until the cache is
+// flushed with el_flush_cache(). Blocks too large for the cache, blocks
+// that would overflow their bin, and blocks on file-backed heaps are
+// freed with el_free().
+void el_free_sized(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    size_t bin = size / EL_CACHE_GRANULE;
+    if (el_ctl.file_header != NULL || bin == 0 || bin >= EL_CACHE_CLASSES) {
+        el_free(ptr);
+        return;
+    }
+    el_lock();
+    // the bin and the quarantine may be changed by other threads
+    if (el_ctl.cache[bin].count >= EL_CACHE_BIN_MAX || el_ctl.quarantine.budget > 0) {
+        el_unlock();
+        el_free(ptr);
+        return;
+    }
+    if (el_ctl.profile != NULL) {
+        el_profile_free(ptr);
+    }
+    el_cachebin_t *cbin = &el_ctl.cache[bin];
+    *(void **) ptr = cbin->head;
+    cbin->head = ptr;
+    cbin->count++;
+    el_ctl.cache_blocks++;
+    el_unlock();
+}
+
+// Free every block parked in the size-class cache with el_release() so
+// that they are coalesced with their neighbours and returned to the
+// available list.
+void el_flush_cache() {
+    el_lock();
+    for (int bin = 0; bin < EL_CACHE_CLASSES; bin++) {
+        el_cachebin_t *cbin = &el_ctl.cache[bin];
+        while (cbin->head != NULL) {
+            void *ptr = cbin->head;
+            cbin->head = *(void **) ptr;
+            el_release(ptr);
+        }
+        cbin->count = 0;
+    }
+    el_ctl.cache_blocks = 0;
+    el_unlock();
+}
+
+// Handle-based allocation and compaction
+
+// Return the handle whose block is block or EL_NO_HANDLE if block was
+// not allocated by el_halloc(). The index stored at the start of the
+// payload is only trusted if the handle table agrees with it.
+static el_handle_t el_block_handle(el_blockhead_t *block) {
+    if (block->size < sizeof(el_handle_t)) {
+        return EL_NO_HANDLE;
+    }
+    el_handle_t handle = *(el_handle_t *) PTR_PLUS_BYTES(block, sizeof(el_blockhead_t));
+    if (handle < 0 || handle >= el_ctl.handle_count || el_ctl.handles[handle].block != block) {
+        return EL_NO_HANDLE;
+    }
+    return handle;
+}
+
+// Allocate a block of at least nbytes which el_compact() may move and
+// return a handle to it. The block must be locked with el_hlock() to get
+// a pointer to its memory; the pointer is only valid until the matching
+// el_hunlock(). Handles are not supported for file-backed heaps as the
+// handle table is private to the process. Returns EL_NO_HANDLE if the
+// allocation fails.
+el_handle_t el_halloc(size_t nbytes) {
+    if (el_ctl.file_header != NULL) {
+        fprintf(stderr,"el_halloc: handles are not supported for file-backed heaps\n");
+        return EL_NO_HANDLE;
+    }
+
+    el_lock();
+    if (el_ctl.handle_free == EL_NO_HANDLE || el_ctl.handles == NULL) {
+        // double the size of the table and chain the new entries onto
+        // the unused list
+        el_handle_t count = el_ctl.handle_count == 0 ? 16 : 2 * el_ctl.handle_count;
+        el_handleent_t *handles = realloc(el_ctl.handles, count * sizeof(el_handleent_t));
+        if (handles == NULL) {
+            el_unlock();
+            return EL_NO_HANDLE;
+        }
+        for (el_handle_t i = el_ctl.handle_count; i < count; i++) {
+            handles[i].block = NULL;
+            handles[i].locks = 0;
+            handles[i].next_free = (i + 1 < count) ? i + 1 : EL_NO_HANDLE;
+        }
+        el_ctl.handle_free = el_ctl.handle_count;
+        el_ctl.handles = handles;
+        el_ctl.handle_count = count;
+    }
+
+    void *ptr = el_malloc(sizeof(el_handle_t) + nbytes);
+    if (ptr == NULL) {
+        el_unlock();
+        return EL_NO_HANDLE;
+    }
+
+    el_handle_t handle = el_ctl.handle_free;
+    el_handleent_t *ent = &el_ctl.handles[handle];
+    el_ctl.handle_free = ent->next_free;
+    ent->block = PTR_MINUS_BYTES(ptr, sizeof(el_blockhead_t));
+    ent->locks = 0;
+    *(el_handle_t *) ptr = handle;
+    el_unlock();
+    return handle;
+}
+
+// Pin the block for handle in place and return a pointer to its usable
+// memory. Locks nest; the block may move again once every el_hlock() has
+// been matched by an el_hunlock().
+void *el_hlock(el_handle_t handle) {
+    el_lock();
+    el_handleent_t *ent = &el_ctl.handles[handle];
+    ent->locks++;
+    void *ptr = PTR_PLUS_BYTES(ent->block, sizeof(el_blockhead_t) + sizeof(el_handle_t));
+    el_unlock();
+    return ptr;
+}
+
+// Release one lock on the block for handle taken by el_hlock().
+void el_hunlock(el_handle_t handle) {
+    el_lock();
+    el_handleent_t *ent = &el_ctl.handles[handle];
+    assert(ent->locks > 0);
+    ent->locks--;
+    el_unlock();
+}
+
+// Free the block for handle and return the handle to the unused list.
+// Does nothing for EL_NO_HANDLE.
+void el_hfree(el_handle_t handle) {
+    if (handle == EL_NO_HANDLE) {
+        return;
+    }
+    el_lock();
+    el_handleent_t *ent = &el_ctl.handles[handle];
+    el_free(PTR_PLUS_BYTES(ent->block, sizeof(el_blockhead_t)));
+    ent->block = NULL;
+    ent->locks = 0;
+    ent->next_free = el_ctl.handle_free;
+    el_ctl.handle_free = handle;
+    el_unlock();
+}
+
+// Turn the memory from start up to end into a single available block
+// and add it to the front of the available list.
+static void el_make_avail_block(void *start, void *end) {
+    el_blockhead_t *block = start;
+    block->size = PTR_MINUS_PTR(end, start) - EL_BLOCK_OVERHEAD;
+    block->state = EL_AVAILABLE;
+    el_get_footer(block)->size = block->size;
+    el_add_block_front(el_ctl.avail, block);
+}
+
+// Slide blocks owned by unlocked handles toward heap_start to remove the
+// free space between them. The size-class cache and deferred frees are
+// flushed first. Walks the heap from bottom to top in address
+// order with el_block_above(), gathering available blocks into a hole
+// and moving each movable used block down to the bottom of the hole.
+// Blocks from el_malloc() and locked handles cannot move; the hole below
+// them becomes an available block. If the top block is movable or free,
+// all free space ends up in one available block at the top of the heap
+// which el_trim() can return to the system. Returns the number of blocks
+// moved.
+size_t el_compact() {
+    if (el_ctl.file_header != NULL || el_ctl.backend != EL_BACKEND_LIST) {
+        return 0;
+    }
+    el_lock();
+    el_flush_cache();
+    el_release_deferred(0);
+
+    size_t moved = 0;
+    void *hole = NULL;          // start of free space gathered so far or NULL
+    el_blockhead_t *block = el_ctl.heap_start;
+    while (block != NULL) {
+        el_blockhead_t *next = el_block_above(block);
+        if (block->state == EL_AVAILABLE) {
+            el_remove_block(el_ctl.avail, block);
+            if (hole == NULL) {
+                hole = block;
+            }
+        }
+        else if (hole != NULL) {
+            el_handle_t handle = el_block_handle(block);
+            if (handle != EL_NO_HANDLE && el_ctl.handles[handle].locks == 0) {
+                size_t bytes = block->size + EL_BLOCK_OVERHEAD;
+                el_remove_block(el_ctl.used, block);
+                memmove(hole, block, bytes);
+                el_ctl.handles[handle].block = hole;
+                el_add_block_front(el_ctl.used, hole);
+                hole = PTR_PLUS_BYTES(hole, bytes);
+                moved++;
+            }
+            else {
+                el_make_avail_block(hole, block);
+                hole = NULL;
+            }
+        }
+        block = next;
+    }
+    if (hole != NULL) {
+        el_make_avail_block(hole, el_ctl.heap_end);
+    }
+    el_unlock();
+    return moved;
+}
+
+// Return whole pages at the top of the heap to the system if the top
+// block is available, leaving at least pad usable bytes in it. Most
+// effective after el_compact(). File-backed heaps are never trimmed.
+// Returns the number of bytes removed from the heap.
+size_t el_trim(size_t pad) {
+    if (el_ctl.file_header != NULL || el_ctl.heap_start == NULL ||
+        el_ctl.backend != EL_BACKEND_LIST) {
+        return 0;
+    }
+
+    el_lock();
+    el_blockfoot_t *top_foot = PTR_MINUS_BYTES(el_ctl.heap_end, sizeof(el_blockfoot_t));
+    el_blockhead_t *top = el_get_header(top_foot);
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t keep = PTR_MINUS_PTR(top, el_ctl.heap_start) + EL_BLOCK_OVERHEAD + pad;
+    keep = (keep + page - 1) / page * page;
+    if (top->state != EL_AVAILABLE || keep >= el_ctl.heap_bytes) {
+        el_unlock();
+        return 0;
+    }
+
+    size_t released = el_ctl.heap_bytes - keep;
+    el_remove_block(el_ctl.avail, top);
+    munmap(PTR_PLUS_BYTES(el_ctl.heap_start, keep), released);
+    el_ctl.heap_bytes = keep;
+    el_ctl.heap_end = PTR_PLUS_BYTES(el_ctl.heap_start, keep);
+    el_make_avail_block(top, el_ctl.heap_end);
+    el_unlock();
+    return released;
+}
+
+// Background maintenance
+
+// Return the microseconds elapsed since start
+static long el_elapsed_us(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+// Release blocks on the list of deferred frees with el_release() in
+// batches of EL_MAINT_BATCH, dropping the lock between batches so that
+// foreground operations wait for at most one batch. Stops early once
+// budget_us microseconds have passed since start; a budget of 0 means no
+// limit. Returns the number of blocks released.
+static size_t el_release_deferred_budget(long budget_us, struct timespec *start) {
+    size_t released = 0;
+    while (1) {
+        el_lock();
+        for (int i = 0; i < EL_MAINT_BATCH && el_ctl.deferred != NULL; i++) {
+            void *ptr = el_ctl.deferred;
+            el_ctl.deferred = *(void **) ptr;
+            el_ctl.deferred_count--;
+            el_release(ptr);
+            el_ctl.maint.released++;
+            released++;
+        }
+        int more = el_ctl.deferred != NULL;
+        el_unlock();
+        if (!more || (budget_us > 0 && el_elapsed_us(start) >= budget_us)) {
+            return released;
+        }
+    }
+}
+
+// Release deferred frees within budget_us microseconds from now, or all
+// of them if budget_us is 0. Returns the number of blocks released.
+static size_t el_release_deferred(long budget_us) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    return el_release_deferred_budget(budget_us, &start);
+}
+
+// Give the memory of available blocks that have stayed free for a whole
+// maintenance cycle back to the system with madvise(). A block is marked
+// idle the first cycle it is seen and advised the next if it has not been
+// split or merged in between, which clears its flags. Only whole pages
+// strictly inside the payload are advised so headers and footers are
+// untouched. Returns the number of bytes advised.
+static size_t el_advise_idle(long budget_us, struct timespec *start) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t advised = 0;
+    int checked = 0;
+    el_lock();
+    for (el_blockhead_t *block = el_ctl.avail->beg->next; block != el_ctl.avail->end;
+         block = block->next) {
+        if (!(block->flags & EL_FLAG_IDLE)) {
+            block->flags |= EL_FLAG_IDLE;
+        }
+        else if (!(block->flags & EL_FLAG_ADVISED)) {
+            size_t lo = (size_t) PTR_PLUS_BYTES(block, sizeof(el_blockhead_t));
+            size_t hi = (size_t) el_get_footer(block);
+            lo = (lo + page - 1) / page * page;
+            hi = hi / page * page;
+            if (hi > lo && madvise((void *) lo, hi - lo, MADV_DONTNEED) == 0) {
+                advised += hi - lo;
+            }
+            block->flags |= EL_FLAG_ADVISED;
+        }
+        if (++checked % 64 == 0 && budget_us > 0 && el_elapsed_us(start) >= budget_us) {
+            break;
+        }
+    }
+    el_unlock();
+    return advised;
+}
+
+// Run one maintenance cycle: release deferred frees, advise long-idle
+// available blocks and trim the top of the heap, leaving EL_MAINT_TRIM_PAD
+// bytes. Stops between steps once budget_us microseconds have passed; a
+// budget of 0 means no limit. Run by the maintenance thread every period
+// but may also be called directly.
+void el_maintain(long budget_us) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    el_maint_t *maint = &el_ctl.maint;
+
+    el_release_deferred_budget(budget_us, &start);
+    if (el_ctl.backend == EL_BACKEND_LIST && el_ctl.file_header == NULL &&
+        (budget_us == 0 || el_elapsed_us(&start) < budget_us)) {
+        maint->advised_bytes += el_advise_idle(budget_us, &start);
+        if (budget_us == 0 || el_elapsed_us(&start) < budget_us) {
+            maint->trimmed_bytes += el_trim(EL_MAINT_TRIM_PAD);
+        }
+    }
+    maint->cycles++;
+}
+
+// Body of the maintenance thread: runs el_maintain() every period_ms
+// milliseconds until el_stop_maintenance() is called.
+static void *el_maint_thread(void *arg) {
+    el_maint_t *maint = &el_ctl.maint;
+    pthread_mutex_lock(&maint->sleep_lock);
+    while (!maint->stop) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec += maint->period_ms / 1000;
+        wake.tv_nsec += (maint->period_ms % 1000) * 1000000L;
+        if (wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&maint->wake, &maint->sleep_lock, &wake);
+        if (!maint->stop) {
+            pthread_mutex_unlock(&maint->sleep_lock);
+            el_maintain(maint->budget_us);
+            pthread_mutex_lock(&maint->sleep_lock);
+        }
+    }
+    pthread_mutex_unlock(&maint->sleep_lock);
+    return NULL;
+}
+
+// Start a thread which runs el_maintain() every period_ms milliseconds
+// with a budget of budget_us microseconds. While it runs, el_free() only
+// defers blocks and the thread does the coalescing. Locking is enabled
+// so the heap may be used from any thread. Not available for file-backed
+// heaps. Returns 0 on success or -1 on failure.
+int el_start_maintenance(long period_ms, long budget_us) {
+    el_maint_t *maint = &el_ctl.maint;
+    if (maint->running || el_ctl.file_header != NULL || period_ms <= 0) {
+        return -1;
+    }
+    el_enable_locking();
+    pthread_mutex_init(&maint->sleep_lock, NULL);
+    pthread_cond_init(&maint->wake, NULL);
+    maint->period_ms = period_ms;
+    maint->budget_us = budget_us;
+    maint->stop = 0;
+    maint->running = 1;
+    if (pthread_create(&maint->thread, NULL, el_maint_thread, NULL) != 0) {
+        maint->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the maintenance thread and release any frees it has not got to
+// yet. Does nothing if the thread is not running.
+void el_stop_maintenance() {
+    el_maint_t *maint = &el_ctl.maint;
+    if (!maint->running) {
+        return;
+    }
+    pthread_mutex_lock(&maint->sleep_lock);
+    maint->stop = 1;
+    pthread_cond_signal(&maint->wake);
+    pthread_mutex_unlock(&maint->sleep_lock);
+    pthread_join(maint->thread, NULL);
+    pthread_cond_destroy(&maint->wake);
+    pthread_mutex_destroy(&maint->sleep_lock);
+    el_lock();
+    maint->running = 0;
+    el_unlock();
+    el_release_deferred(0);
+}
+
+// Soft memory limit
+
+// Set a soft limit of bytes on the size of the heap; 0 removes the limit.
+// With a limit set, a failed el_malloc() asks the callbacks registered
+// with el_on_pressure() to release memory and only then grows the heap
+// toward the limit or fails. Callbacks are also run once each time usage
+// crosses EL_LIMIT_HIGH_PERCENT of the limit. Without a limit the heap
+// never grows. The heap only grows with the list backend and is not
+// file-backed. Returns 0 on success or -1 if the heap is file-backed or
+// already larger than bytes.
+int el_set_limit(size_t bytes) {
+    if (el_ctl.file_header != NULL) {
+        fprintf(stderr,"el_set_limit: file-backed heaps have a fixed size\n");
+        return -1;
+    }
+    if (bytes > 0 && bytes < el_ctl.heap_bytes) {
+        fprintf(stderr,"el_set_limit: limit %lu below current heap size %lu\n",
+                bytes, el_ctl.heap_bytes);
+        return -1;
+    }
+    el_lock();
+    el_ctl.limit.bytes = bytes;
+    el_ctl.limit.above_high = 0;
+    el_unlock();
+    return 0;
+}
+
+// Register callback to be called with arg on memory pressure. Callbacks
+// run in the order registered while the allocator lock is held; they may
+// call el_free() and el_malloc() though allocations made from a callback
+// never cause further pressure events. Returns 0 on success or -1 if
+// EL_PRESSURE_MAX callbacks are already registered.
+int el_on_pressure(el_pressure_fn callback, void *arg) {
+    el_limit_t *limit = &el_ctl.limit;
+    if (callback == NULL || limit->ncallbacks >= EL_PRESSURE_MAX) {
+        return -1;
+    }
+    el_lock();
+    limit->callbacks[limit->ncallbacks] = callback;
+    limit->args[limit->ncallbacks] = arg;
+    limit->ncallbacks++;
+    el_unlock();
+    return 0;
+}
+
+// Return the bytes in use, including overhead, in the selected backend
+static size_t el_usage() {
+    if (el_ctl.backend == EL_BACKEND_BUDDY) {
+        return el_ctl.buddy.used_bytes;
+    }
+    return el_ctl.used->bytes;
+}
+
+// Run every pressure callback with the given level and request size,
+// adding the bytes they report to the released count.
+static void el_pressure(int level, size_t nbytes) {
+    el_limit_t *limit = &el_ctl.limit;
+    limit->in_pressure = 1;
+    for (int i = 0; i < limit->ncallbacks; i++) {
+        limit->released_bytes += limit->callbacks[i](level, nbytes, limit->args[i]);
+    }
+    limit->in_pressure = 0;
+}
+
+// Grow the heap so that an available block of at least nbytes sits at its
+// top. The heap at least doubles, to save on system calls, but never
+// beyond the limit. New pages are mapped directly above heap_end and
+// merged with the top block when it is available. Returns 0 on success or
+// -1 if the limit would be passed or the pages can't be mapped there.
+static int el_grow_heap(size_t nbytes) {
+    if (el_ctl.backend != EL_BACKEND_LIST || el_ctl.file_header != NULL) {
+        return -1;
+    }
+    el_blockfoot_t *top_foot = PTR_MINUS_BYTES(el_ctl.heap_end, sizeof(el_blockfoot_t));
+    el_blockhead_t *top = el_get_header(top_foot);
+    size_t have = top->state == EL_AVAILABLE ? top->size + EL_BLOCK_OVERHEAD : 0;
+    size_t need = nbytes + EL_BLOCK_OVERHEAD > have ? nbytes + EL_BLOCK_OVERHEAD - have : 0;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t grow = el_ctl.heap_bytes > need ? el_ctl.heap_bytes : need;
+    grow = (grow + page - 1) / page * page;
+    if (el_ctl.heap_bytes + grow > el_ctl.limit.bytes) {
+        grow = el_ctl.limit.bytes - el_ctl.heap_bytes;
+        grow = grow / page * page;
+    }
+    if (grow < need) {
+        return -1;
+    }
+
+    void *pages = mmap(el_ctl.heap_end, grow, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED) {
+        return -1;
+    }
+    if (pages != el_ctl.heap_end) {
+        munmap(pages, grow);    // something else is mapped above the heap
+        return -1;
+    }
+
+    void *start = el_ctl.heap_end;
+    if (top->state == EL_AVAILABLE) {
+        el_remove_block(el_ctl.avail, top);
+        start = top;
+    }
+    el_ctl.heap_bytes += grow;
+    el_ctl.heap_end = PTR_PLUS_BYTES(el_ctl.heap_start, el_ctl.heap_bytes);
+    el_make_avail_block(start, el_ctl.heap_end);
+    el_ctl.limit.grows++;
+    el_ctl.limit.grown_bytes += grow;
+    return 0;
+}
+
+// Called by el_malloc() when a limit is set with ptr being the result of
+// the allocation so far. A failed allocation is a critical pressure
+// event: the callbacks run and the allocation is retried, then the heap
+// is grown and it is retried again. A successful allocation which takes
+// usage above the high-water mark runs the callbacks once until usage
+// falls back below it. Returns the allocated block or NULL.
+static void *el_limit_malloc(void *ptr, size_t nbytes) {
+    el_limit_t *limit = &el_ctl.limit;
+    if (ptr == NULL) {
+        limit->critical_events++;
+        el_pressure(EL_PRESSURE_CRITICAL, nbytes);
+        el_flush_cache();
+        el_release_deferred(0);
+        ptr = el_backend_malloc(nbytes);
+        if (ptr == NULL && el_grow_heap(nbytes) == 0) {
+            ptr = el_backend_malloc(nbytes);
+        }
+        if (ptr == NULL) {
+            limit->failures++;
+            return NULL;
+        }
+    }
+
+    size_t high = limit->bytes * EL_LIMIT_HIGH_PERCENT / 100;
+    if (el_usage() < high) {
+        limit->above_high = 0;
+    }
+    else if (!limit->above_high) {
+        limit->above_high = 1;
+        limit->high_events++;
+        el_pressure(EL_PRESSURE_HIGH, nbytes);
+    }
+    return ptr;
+}
+
+// Print the soft limit and its pressure counters. Shown by
+// el_print_stats() when a limit is set. The format appears as follows.
+//
+// LIMIT: {bytes: 8192  high: 6144  usage: 6320}
+//   pressure: {high: 1  critical: 2  released: 2400}
+//   growth: {grows: 1  bytes: 4096  failures: 1}
+void el_print_limit() {
+    el_limit_t *limit = &el_ctl.limit;
+    printf("LIMIT: {bytes: %lu  high: %lu  usage: %lu}\n", limit->bytes,
+           limit->bytes * EL_LIMIT_HIGH_PERCENT / 100, el_usage());
+    printf("  pressure: {high: %lu  critical: %lu  released: %lu}\n",
+           limit->high_events, limit->critical_events, limit->released_bytes);
+    printf("  growth: {grows: %lu  bytes: %lu  failures: %lu}\n",
+           limit->grows, limit->grown_bytes, limit->failures);
+}
+
+// Latency instrumentation
+
+#ifdef EL_LATENCY
+// Return a monotonic timestamp in nanoseconds. clock_gettime() is used
+// rather than reading the cycle counter so that values are in real time
+// units on every machine.
+static size_t el_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+#endif
+
+// Return the histogram bucket for value
+static size_t el_histogram_bucket(size_t value) {
+    if (value < EL_HIST_SUB) {
+        return value;
+    }
+    int e = 63 - __builtin_clzl(value); // value lies in [2^e, 2^(e+1))
+    int shift = e - 3;                  // 3 bits for the EL_HIST_SUB sub-buckets
+    return (e - 2) * EL_HIST_SUB + ((value >> shift) & (EL_HIST_SUB - 1));
+}
+
+// Return the smallest value recorded in the given bucket
+static size_t el_histogram_lowest(size_t bucket) {
+    if (bucket < EL_HIST_SUB) {
+        return bucket;
+    }
+    int e = bucket / EL_HIST_SUB + 2;
+    return (EL_HIST_SUB + bucket % EL_HIST_SUB) << (e - 3);
+}
+
+// Add value to hist
+void el_histogram_record(el_histogram_t *hist, size_t value) {
+    hist->count++;
+    hist->total += value;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    hist->buckets[el_histogram_bucket(value)]++;
+}
+
+// Return the value at the given percentile (0-100) of hist: the highest
+// value of the bucket holding it, capped at the largest value recorded.
+// Returns 0 for an empty histogram.
+size_t el_histogram_percentile(const el_histogram_t *hist, double percent) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    double rank = hist->count * percent / 100.0;
+    size_t seen = 0;
+    for (size_t b = 0; b < EL_HIST_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen > 0 && seen >= rank && b + 1 < EL_HIST_BUCKETS) {
+            size_t high = el_histogram_lowest(b + 1) - 1;
+            return high < hist->max ? high : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+// Return the latency histograms gathered when EL_LATENCY is defined; all
+// counts stay 0 otherwise.
+const el_latency_t *el_get_latency() {
+    return &el_ctl.latency;
+}
+
+// Clear all latency histograms
+void el_reset_latency() {
+    el_lock();
+    memset(&el_ctl.latency, 0, sizeof(el_ctl.latency));
+    el_unlock();
+}
+
+// Print one line summarizing hist for el_print_latency()
+static void el_print_histogram(const char *name, const el_histogram_t *hist) {
+    printf("  %-7s {count: %lu  mean: %.1f  p50: %lu  p99: %lu  p99.9: %lu  max: %lu}\n",
+           name, hist->count, hist->count > 0 ? (double) hist->total / hist->count : 0.0,
+           el_histogram_percentile(hist, 50), el_histogram_percentile(hist, 99),
+           el_histogram_percentile(hist, 99.9), hist->max);
+}
+
+// Print the latency histograms. Shown by el_print_stats() when built with
+// EL_LATENCY defined. The format appears as follows.
+//
+// LATENCY (ns):
+//   malloc: {count: 3  mean: 95.3  p50: 79  p99: 159  p99.9: 159  max: 152}
+//   free:   {count: 1  mean: 240.0  p50: 240  p99: 240  p99.9: 240  max: 240}
+//   merge:  {count: 1  mean: 60.0  p50: 60  p99: 60  p99.9: 60  max: 60}
+// SCAN (blocks examined per search):
+//   search: {count: 3  mean: 1.0  p50: 1  p99: 1  p99.9: 1  max: 1}
+void el_print_latency() {
+    const char *names[EL_LAT_OPS] = {"malloc:", "free:", "merge:"};
+    printf("LATENCY (ns):\n");
+    for (int op = 0; op < EL_LAT_OPS; op++) {
+        el_print_histogram(names[op], &el_ctl.latency.ops[op]);
+    }
+    printf("SCAN (blocks examined per search):\n");
+    el_print_histogram("search:", &el_ctl.latency.scan);
+}
+
+// Use-after-free quarantine
+
+// Enable the quarantine holding up to budget bytes of freed blocks,
+// counting overhead, or disable it with 0 which releases every block in
+// it. While enabled, el_free() poisons blocks and keeps them out of the
+// available list so a stale pointer can't alias a new allocation; writes
+// through one are reported when the block leaves the quarantine. Only
+// supported by the list allocator on private heaps. Returns 0 on success
+// or -1 on failure.
+int el_set_quarantine(size_t budget) {
+    if (budget > 0 && (el_ctl.backend != EL_BACKEND_LIST || el_ctl.file_header != NULL ||
+                       el_ctl.heap_start == NULL)) {
+        fprintf(stderr,"el_set_quarantine: needs the list allocator on a private heap\n");
+        return -1;
+    }
+    el_lock();
+    el_quarantine_t *q = &el_ctl.quarantine;
+    if (q->list == NULL) {
+        el_init_blocklist(&q->list_actual);
+        q->list = &q->list_actual;
+    }
+    el_flush_cache();           // parked blocks would bypass the quarantine
+    q->budget = budget;
+    el_trim_quarantine(budget);
+    el_unlock();
+    return 0;
+}
+
+// Check that the payload of a block leaving the quarantine still holds
+// the poison pattern, reporting the first overwritten byte if not.
+static void el_check_poison(el_blockhead_t *block) {
+    unsigned char *payload = PTR_PLUS_BYTES(block, sizeof(el_blockhead_t));
+    for (size_t i = 0; i < block->size; i++) {
+        if (payload[i] != EL_POISON_BYTE) {
+            fprintf(stderr,"el_free: use after free of %p: byte %lu overwritten\n",
+                    payload, i);
+            el_ctl.quarantine.corruptions++;
+            return;
+        }
+    }
+}
+
+// Check and release the oldest blocks in the quarantine until it holds
+// no more than keep bytes.
+static void el_trim_quarantine(size_t keep) {
+    el_quarantine_t *q = &el_ctl.quarantine;
+    while (q->list->length > 0 && q->list->bytes > keep) {
+        el_blockhead_t *oldest = q->list->end->prev;
+        el_check_poison(oldest);
+        q->evictions++;
+        el_coalesce(q->list, oldest);
+    }
+}
+
+// Put block, just freed, into the quarantine: poison its payload and move
+// it from the used list to the front of the quarantine list. The oldest
+// blocks are released while the quarantine is over budget.
+static void el_quarantine_block(el_blockhead_t *block) {
+    el_quarantine_t *q = &el_ctl.quarantine;
+    memset(PTR_PLUS_BYTES(block, sizeof(el_blockhead_t)), EL_POISON_BYTE, block->size);
+    el_remove_block(el_ctl.used, block);
+    block->state = EL_QUARANTINED;
+    el_add_block_front(q->list, block);
+    el_trim_quarantine(q->budget);
+}
+
+// Check and release every block in the quarantine. Called by el_malloc()
+// when it runs out of space.
+void el_flush_quarantine() {
+    if (el_ctl.quarantine.list == NULL) {
+        return;
+    }
+    el_lock();
+    el_trim_quarantine(0);
+    el_unlock();
+}
+
+// Print the quarantine counters and list. Shown by el_print_stats()
+// while the quarantine is enabled. The format appears as follows.
+//
+// QUARANTINE: {budget: 256  evictions: 1  corruptions: 0  double frees: 0}
+// QUARANTINE LIST: {length:   1  bytes:   168}
+//   [  0] head @ 0x6000000000a8 {state: q  size:   128}
+//         foot @ 0x600000000120 {size:   128}
+void el_print_quarantine() {
+    el_quarantine_t *q = &el_ctl.quarantine;
+    printf("QUARANTINE: {budget: %lu  evictions: %lu  corruptions: %lu  double frees: %lu}\n",
+           q->budget, q->evictions, q->corruptions, q->double_frees);
+    printf("QUARANTINE LIST: ");
+    el_print_blocklist(q->list);
 }
@@ -1,6 +1,19 @@
 #ifndef EL_MALLOC_H
 #define EL_MALLOC_H
 
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+#include <atomic>
+#define EL_ATOMIC(type) std::atomic<type>
+extern "C" {
+#else
+#include <stdatomic.h>
+#define EL_ATOMIC(type) _Atomic type
+#endif
+
 // macro to add a byte offset to a pointer, arguments are a pointer
 // and a number of bytes (usually size_t)
 #define PTR_PLUS_BYTES(ptr, off) ((void *) (((size_t) (ptr)) + ((size_t) (off))))
@@ -22,6 +35,7 @@
 #define EL_USED          'u'    // block state indicating in use
 #define EL_BEGIN_BLOCK   'B'    // block state indicating dummy beginning node in a list
 #define EL_END_BLOCK     'E'    // block state indicating dummy ending node in a list
+#define EL_QUARANTINED   'q'    // block state indicating freed but held in quarantine
 #define EL_UNINITIALIZED  0     // indication of uninitialized data
 
 // type which is a "header" for a block of memory; contains info on
@@ -32,6 +46,8 @@
 typedef struct block {
   size_t size;                  // number of bytes of memory in this block
   char state;                   // either EL_AVAILABLE or EL_USED
+  char flags;                   // EL_FLAG_IDLE/EL_FLAG_ADVISED bits for available blocks
+  unsigned int index;           // slot in the available index while in the available list; fits in padding after state
   struct block *next;           // pointer to next block in same list
   struct block *prev;           // pointer to previous block in same list
 } el_blockhead_t;
@@ -62,6 +78,238 @@ typedef struct {
 } el_blocklist_t;
 // NOTE: total available bytes for/in use in the list is (bytes - length*EL_BLOCK_OVERHEAD)
 
+// Size of the region at the beginning of a heap file that holds the
+// el_fileheader_t; one page so that heap_start stays page aligned and
+// lands on EL_HEAP_START_ADDRESS.
+#define EL_FILE_HEADER_BYTES ((size_t) 4096)
+
+// Magic bytes at the beginning of every heap file created by el_open()
+#define EL_FILE_MAGIC "ELHEAP01"
+
+// Offset used in a el_filelist_t to indicate an empty list
+#define EL_NO_OFFSET (-1L)
+
+// Type for the saved state of a blocklist in a heap file. The dummy
+// beg/end nodes live in el_ctl rather than on the heap so the links
+// into/out of them cannot be saved; instead the first and last blocks of
+// the list are recorded as offsets from heap_start. All other links
+// stay valid because the heap is always mapped at EL_HEAP_START_ADDRESS.
+typedef struct {
+  long first;                   // offset of first block in list or EL_NO_OFFSET
+  long last;                    // offset of last block in list or EL_NO_OFFSET
+  size_t length;                // length of the list
+  size_t bytes;                 // bytes in the list including overhead
+} el_filelist_t;
+
+// Type for the header at the beginning of a heap file or shared memory
+// object. Records the el_ctl state so that el_open() can restore a heap
+// without walking or rebuilding any of its blocks, and holds the lock
+// that serializes processes sharing the heap.
+typedef struct {
+  char magic[8];                // EL_FILE_MAGIC, without the trailing \0
+  pthread_mutex_t lock;         // process-shared, robust lock held during each operation
+  size_t heap_bytes;            // number of bytes in the heap after the header
+  el_filelist_t avail;          // saved state of the available list
+  el_filelist_t used;           // saved state of the used list
+  int unusable;                 // 1 once a crash was found to have left the blocks torn
+} el_fileheader_t;
+
+// Parameters of the size-class cache used by el_free_sized(). Bin b
+// holds blocks of at least b*EL_CACHE_GRANULE bytes, so sizes below
+// EL_CACHE_GRANULE*EL_CACHE_CLASSES are cached; each bin holds at most
+// EL_CACHE_BIN_MAX blocks.
+#define EL_CACHE_GRANULE  8
+#define EL_CACHE_CLASSES  32
+#define EL_CACHE_BIN_MAX  64
+
+// Type for one bin of the size-class cache: a stack of parked blocks
+// linked through the first bytes of their payloads.
+typedef struct {
+  void *head;                   // usable memory of the most recently parked block or NULL
+  size_t count;                 // number of blocks in the bin
+} el_cachebin_t;
+
+// Type for the optional side table of available blocks enabled by
+// el_use_avail_index(). The sizes of available blocks are kept in a dense
+// array so el_find_first_avail() scans contiguous memory rather than
+// following next pointers to headers scattered across the heap. Blocks
+// are appended as they are added to the front of the available list so
+// the table, read from the end, is in list order. A removed block leaves
+// a size of 0 in its slot, which never satisfies a search; the table is
+// compacted when half of it is removed slots.
+typedef struct {
+  int enabled;                  // 1 if the table is being maintained
+  size_t *sizes;                // size of the block in each slot or 0 for a removed block
+  el_blockhead_t **blocks;      // block in each slot or NULL for a removed block
+  size_t count;                 // number of slots in use including removed blocks
+  size_t live;                  // number of slots holding a block
+  size_t capacity;              // number of slots allocated
+} el_availindex_t;
+
+// Backends selectable with el_set_backend() before el_init()
+#define EL_BACKEND_LIST   0     // explicit list allocator with boundary tags (default)
+#define EL_BACKEND_BUDDY  1     // binary buddy allocator in el_buddy.c
+
+// Parameters of the buddy backend. Blocks are 2^order bytes for orders
+// from EL_BUDDY_MIN_ORDER up to the largest power of two that fits in
+// the heap.
+#define EL_BUDDY_MIN_ORDER      5
+#define EL_BUDDY_MAX_ORDERS     48
+#define EL_BUDDY_NOT_ALLOCATED  0xFF
+
+// Type for the state of the buddy backend. Each order has a bitmap with
+// a bit per block of that order, set if the block is free. Allocated
+// blocks have no header: the order of the block starting at each
+// minimum-sized slot of the heap is kept in alloc_order.
+typedef struct {
+  int max_order;                // order of the block covering the whole heap
+  unsigned long *bitmap;        // free bitmaps for all orders, one after another
+  size_t word_offset[EL_BUDDY_MAX_ORDERS]; // first word of the bitmap of each order
+  size_t free_count[EL_BUDDY_MAX_ORDERS];  // number of free blocks of each order
+  unsigned char *alloc_order;   // order of the block allocated at each slot or EL_BUDDY_NOT_ALLOCATED
+  size_t used_blocks;           // number of allocated blocks
+  size_t used_bytes;            // total bytes in allocated blocks
+} el_buddy_t;
+
+// Type for a handle to a movable block allocated with el_halloc(); an
+// index into the handle table in el_ctl.
+typedef long el_handle_t;
+
+// Handle value indicating failure or no handle
+#define EL_NO_HANDLE (-1L)
+
+// Type for an entry in the handle table. While a handle is in use, block
+// tracks where its block currently is; the block is never moved while
+// locks is non-zero. The first bytes of the payload of a handle's block
+// hold its index so that el_compact() can find the handle for a block.
+typedef struct {
+  el_blockhead_t *block;        // current location of the block or NULL if entry unused
+  int locks;                    // number of outstanding el_hlock() calls
+  el_handle_t next_free;        // next unused entry when this entry is unused
+} el_handleent_t;
+
+// Flags for available blocks used by el_maintain(); cleared whenever a
+// block is added to the available list
+#define EL_FLAG_IDLE     0x01   // block was available at the last maintenance cycle
+#define EL_FLAG_ADVISED  0x02   // interior pages of the block were given back with madvise()
+
+// Defaults for the background maintenance thread
+#define EL_MAINT_BATCH    32     // deferred frees released per lock hold
+#define EL_MAINT_TRIM_PAD 4096   // bytes left free above the top block by el_trim()
+
+// Type for the state of the background maintenance thread started by
+// el_start_maintenance() along with counts of the work it has done.
+typedef struct {
+  int running;                  // 1 while the thread runs and el_free() defers blocks
+  int stop;                     // set by el_stop_maintenance() to end the thread
+  long period_ms;               // milliseconds between maintenance cycles
+  long budget_us;               // microseconds each cycle may take, 0 for no limit
+  pthread_t thread;             // the maintenance thread
+  pthread_mutex_t sleep_lock;   // protects stop while the thread sleeps on wake
+  pthread_cond_t wake;          // signalled to stop the thread early
+  size_t cycles;                // maintenance cycles run
+  size_t released;              // deferred frees released, including those drained by el_malloc()
+  size_t advised_bytes;         // bytes of idle blocks given back with madvise()
+  size_t trimmed_bytes;         // bytes released from the top of the heap with el_trim()
+} el_maint_t;
+
+// Pressure levels passed to callbacks registered with el_on_pressure()
+#define EL_PRESSURE_HIGH      1  // heap usage crossed the high-water mark of the limit
+#define EL_PRESSURE_CRITICAL  2  // an allocation failed; the heap grows or el_malloc() fails next
+
+#define EL_PRESSURE_MAX       8  // most callbacks that may be registered
+#define EL_LIMIT_HIGH_PERCENT 75 // high-water mark as a percentage of the limit
+
+// Type for a pressure callback. Called with the level, the size of the
+// request which caused the event and the argument given to
+// el_on_pressure(). Should el_free() cached memory and return roughly
+// how many bytes were released.
+typedef size_t (*el_pressure_fn)(int level, size_t nbytes, void *arg);
+
+// Type for the soft memory limit set with el_set_limit() along with the
+// registered pressure callbacks and counts of pressure events.
+typedef struct {
+  size_t bytes;                 // most bytes the heap may grow to, 0 for no limit and no growth
+  int above_high;               // 1 while usage is above the high-water mark
+  int in_pressure;              // 1 while callbacks run so they may allocate without recursing
+  el_pressure_fn callbacks[EL_PRESSURE_MAX]; // registered callbacks
+  void *args[EL_PRESSURE_MAX];  // argument for each callback
+  int ncallbacks;               // number of registered callbacks
+  size_t high_events;           // times usage crossed the high-water mark
+  size_t critical_events;       // allocations which failed before callbacks ran
+  size_t released_bytes;        // bytes callbacks reported releasing
+  size_t grows;                 // times the heap was grown
+  size_t grown_bytes;           // total bytes added to the heap
+  size_t failures;              // allocations which failed at the limit
+} el_limit_t;
+
+// Byte written over the payload of quarantined blocks
+#define EL_POISON_BYTE   0xDB
+
+// Type for the use-after-free quarantine set up with el_set_quarantine().
+// Freed blocks wait in a FIFO list with their payloads poisoned until
+// the list holds more than budget bytes; the oldest are then checked
+// and freed for real.
+typedef struct {
+  size_t budget;                // most bytes held including overhead, 0 when disabled
+  el_blocklist_t list_actual;   // space for the list of quarantined blocks, newest first
+  el_blocklist_t *list;         // pointer to list_actual once initialized
+  size_t evictions;             // blocks checked and released from quarantine
+  size_t corruptions;           // evicted blocks whose poison had been overwritten
+  size_t double_frees;          // frees of blocks already in quarantine
+} el_quarantine_t;
+
+// Latency histograms. Values below EL_HIST_SUB get a bucket each; above
+// that each power of two is split into EL_HIST_SUB linear buckets, so a
+// value is recorded to within 1/EL_HIST_SUB of itself as in an HDR
+// histogram. Timing is only compiled in when EL_LATENCY is defined.
+#define EL_HIST_SUB     8
+#define EL_HIST_BUCKETS (64 * EL_HIST_SUB)
+
+// Operations timed when EL_LATENCY is defined
+#define EL_LAT_MALLOC 0         // el_malloc()
+#define EL_LAT_FREE   1         // el_free()
+#define EL_LAT_MERGE  2         // el_merge_block_with_above() when blocks merge
+#define EL_LAT_OPS    3
+
+// Type for a histogram of values such as latencies in nanoseconds
+typedef struct {
+  size_t count;                 // number of values recorded
+  size_t total;                 // sum of the values recorded
+  size_t max;                   // largest value recorded
+  size_t buckets[EL_HIST_BUCKETS]; // count of values in each bucket
+} el_histogram_t;
+
+// Type for the latency data gathered when EL_LATENCY is defined
+typedef struct {
+  el_histogram_t ops[EL_LAT_OPS]; // nanoseconds taken by each timed operation
+  el_histogram_t scan;          // available blocks examined by each el_find_first_avail()
+} el_latency_t;
+
+// Defaults for fixed-size object pools
+#define EL_POOL_MAGAZINE 32     // objects held in each thread's magazine
+
+// Type for a fixed-size object pool created with el_pool_init(). Objects
+// are carved from chunks allocated with el_aligned_alloc(). Free objects
+// are kept in per-thread magazines and, beyond those, on a shared Treiber
+// stack. The top of the stack packs the offset of the top object from
+// heap_start plus one (0 when empty) in its low 32 bits and a tag bumped
+// on every change in its high 32 bits so a compare-and-swap never
+// succeeds on a stale top (the ABA problem).
+typedef struct {
+  size_t obj_size;              // bytes in each object, a multiple of 8
+  size_t chunk_objs;            // objects carved from each chunk
+  EL_ATOMIC(uint64_t) top;      // tagged top of the shared stack of free objects
+  pthread_key_t magazine_key;   // each thread's magazine for this pool
+  pthread_mutex_t grow_lock;    // held while a chunk is added
+  void *chunks;                 // chunks from el_aligned_alloc(), linked through their first word
+  EL_ATOMIC(size_t) chunk_count; // number of chunks
+  EL_ATOMIC(size_t) stack_objs;  // objects on the shared stack
+} el_pool_t;
+
+// State of the sampling heap profiler, defined in el_profile.c
+struct el_profile;
+
 // Type for the global control structure of the allocator. Tracks heap size,
 // start and end addresses, total size, and lists of available and
 // used blocks.
@@ -73,15 +321,41 @@ typedef struct {
   el_blocklist_t used_actual;   // space for the used list data
   el_blocklist_t *avail;        // pointer to avail_actual
   el_blocklist_t *used;         // pointer to used_actual
+  el_fileheader_t *file_header; // header of the heap file or NULL if heap is not file-backed
+  int file_fd;                  // open descriptor for the heap file when file_header is non-NULL
+  el_handleent_t *handles;      // handle table, allocated on first el_halloc()
+  el_handle_t handle_count;     // number of entries in the handle table
+  el_handle_t handle_free;      // first unused entry in the handle table or EL_NO_HANDLE
+  el_cachebin_t cache[EL_CACHE_CLASSES]; // size-class cache filled by el_free_sized()
+  size_t cache_blocks;          // total blocks in all bins of the cache
+  el_availindex_t avail_index;  // side table of available block sizes
+  int backend;                  // EL_BACKEND_LIST or EL_BACKEND_BUDDY
+  el_buddy_t buddy;             // state of the buddy backend when selected
+  struct el_profile *profile;   // sampling profiler state or NULL when not profiling
+  pthread_mutex_t lock;         // recursive lock for all operations once threaded is set
+  int threaded;                 // 1 after el_enable_locking()
+  void *deferred;               // frees deferred to the maintenance thread, linked through payloads
+  size_t deferred_count;        // number of blocks in deferred
+  el_maint_t maint;             // background maintenance thread
+  el_limit_t limit;             // soft memory limit and pressure callbacks
+  el_latency_t latency;         // latency histograms, filled when EL_LATENCY is defined
+  el_quarantine_t quarantine;   // use-after-free quarantine
 } el_ctl_t;
 
 // Main instance of el_ctl_t defined in el_malloc.c
 extern el_ctl_t el_ctl;
 
 // functions defined in el_malloc.c
+int el_set_backend(int backend);
 int el_init();
 void el_print_stats();
+void el_print_cache();
 void el_cleanup();
+int el_open(const char *path);
+int el_shm_open(const char *name, size_t heap_bytes);
+int el_sync();
+long el_ptr_to_offset(void *ptr);
+void *el_offset_to_ptr(long offset);
 
 el_blockfoot_t *el_get_footer(el_blockhead_t *block);
 el_blockhead_t *el_get_header(el_blockfoot_t *foot);
@@ -92,13 +366,126 @@ void el_init_blocklist(el_blocklist_t *list);
 void el_print_blocklist(el_blocklist_t *list);
 void el_add_block_front(el_blocklist_t *list, el_blockhead_t *block);
 void el_remove_block(el_blocklist_t *list, el_blockhead_t *block);
+int el_use_avail_index(int enable);
 
 el_blockhead_t *el_find_first_avail(size_t size);
 el_blockhead_t *el_split_block(el_blockhead_t *block, size_t new_size);
 el_blockhead_t *el_allocate_block(size_t size);
 void *el_malloc(size_t nbytes);
+size_t el_malloc_usable_size(void *ptr);
+void *el_aligned_alloc(size_t alignment, size_t nbytes);
 
 void el_merge_block_with_above(el_blockhead_t *lower);
 void el_free(void *ptr);
+void el_free_sized(void *ptr, size_t size);
+void el_flush_cache();
+
+el_handle_t el_halloc(size_t nbytes);
+void *el_hlock(el_handle_t handle);
+void el_hunlock(el_handle_t handle);
+void el_hfree(el_handle_t handle);
+size_t el_compact();
+size_t el_trim(size_t pad);
+
+void el_enable_locking();
+void el_maintain(long budget_us);
+int el_start_maintenance(long period_ms, long budget_us);
+void el_stop_maintenance();
+
+int el_set_limit(size_t bytes);
+int el_on_pressure(el_pressure_fn callback, void *arg);
+void el_print_limit();
+
+void el_histogram_record(el_histogram_t *hist, size_t value);
+size_t el_histogram_percentile(const el_histogram_t *hist, double percent);
+const el_latency_t *el_get_latency();
+void el_reset_latency();
+void el_print_latency();
+
+int el_set_quarantine(size_t budget);
+void el_flush_quarantine();
+void el_print_quarantine();
+
+// functions defined in el_buddy.c
+int el_buddy_init(void *heap, size_t heap_bytes);
+void el_buddy_cleanup();
+void *el_buddy_malloc(size_t nbytes);
+size_t el_buddy_usable_size(void *ptr);
+void el_buddy_free(void *ptr);
+void el_buddy_print_stats();
+
+// functions defined in el_profile.c
+int el_profile_start(size_t sample_bytes);
+void el_profile_stop();
+void el_profile_malloc(void *ptr, size_t nbytes);
+void el_profile_free(void *ptr);
+void el_dump_profile(FILE *out);
+
+// functions defined in el_pool.c
+int el_pool_init(el_pool_t *pool, size_t obj_size, size_t chunk_objs);
+void el_pool_destroy(el_pool_t *pool);
+void *el_pool_alloc(el_pool_t *pool);
+void el_pool_free(el_pool_t *pool, void *obj);
+void el_pool_print_stats(el_pool_t *pool);
+
+// Inline fast paths for allocation sites with a constant size
+
+// Bin of the size-class cache that el_malloc() checks for a request of n
+// bytes; the bin el_free_sized() parks a block of n bytes in is n/8.
+#define EL_CACHE_BIN(n) (((n) + EL_CACHE_GRANULE - 1) / EL_CACHE_GRANULE)
+
+// 1 if a request of n bytes can be served from the size-class cache
+#define EL_CACHE_BIN_OK(n) (EL_CACHE_BIN(n) > 0 && EL_CACHE_BIN(n) < EL_CACHE_CLASSES)
+
+// Pop a block from the given bin of the size-class cache, falling back on
+// el_malloc(nbytes) when the bin is empty or when locking or profiling
+// require the full path. Used by EL_MALLOC_CONST() with a constant bin.
+static inline void *el_malloc_bin(size_t bin, size_t nbytes) {
+    el_cachebin_t *cbin = &el_ctl.cache[bin];
+    void *ptr = cbin->head;
+    if (ptr == NULL || el_ctl.threaded || el_ctl.profile != NULL) {
+        return el_malloc(nbytes);
+    }
+    cbin->head = *(void **) ptr;
+    cbin->count--;
+    el_ctl.cache_blocks--;
+    return ptr;
+}
+
+// Push ptr onto the given bin of the size-class cache, falling back on
+// el_free_sized(ptr, size) whenever it would not park the block itself.
+// Used by EL_FREE_CONST() with a constant bin.
+static inline void el_free_bin(void *ptr, size_t bin, size_t size) {
+    el_cachebin_t *cbin = &el_ctl.cache[bin];
+    if (ptr == NULL || cbin->count >= EL_CACHE_BIN_MAX || el_ctl.threaded ||
+        el_ctl.profile != NULL || el_ctl.file_header != NULL || el_ctl.quarantine.budget > 0) {
+        el_free_sized(ptr, size);
+        return;
+    }
+    *(void **) ptr = cbin->head;
+    cbin->head = ptr;
+    cbin->count++;
+    el_ctl.cache_blocks++;
+}
+
+// Allocate n bytes where n is usually a compile-time constant. The bin
+// is then worked out by the compiler and the call becomes a pop from that
+// bin of the size-class cache. Other sizes use el_malloc().
+#define EL_MALLOC_CONST(n)                                              \
+    (__builtin_constant_p(n) && EL_CACHE_BIN_OK(n)                      \
+         ? el_malloc_bin(EL_CACHE_BIN(n), (n)) : el_malloc(n))
+
+// Free ptr, allocated with a size of n bytes, where n is usually a
+// compile-time constant, parking it in bin n/8 like el_free_sized(). For
+// multiples of 8 that is the bin EL_MALLOC_CONST(n) pops from so blocks
+// of one size are recycled without touching the heap.
+#define EL_FREE_CONST(ptr, n)                                           \
+    (__builtin_constant_p(n) && (n) / EL_CACHE_GRANULE > 0 &&           \
+     (n) / EL_CACHE_GRANULE < EL_CACHE_CLASSES                          \
+         ? el_free_bin((ptr), (n) / EL_CACHE_GRANULE, (n)) : el_free_sized((ptr), (n)))
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // EL_MALLOC_H
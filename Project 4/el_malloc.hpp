@@ -0,0 +1,141 @@
+// el_malloc.hpp: C++ adapters for the el_malloc() heap. Provides
+// el::memory_resource for std::pmr containers, el::allocator<T> for
+// classic STL containers and el::make<T>()/el::destroy() for single
+// objects. All allocate from the single el heap, which must be set up
+// with el_init() before use and outlive the containers.
+
+#ifndef EL_MALLOC_HPP
+#define EL_MALLOC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include "el_malloc.h"
+
+namespace el {
+
+// Memory resource drawing from the el heap. Requests are passed to
+// el_aligned_alloc() as el_malloc() makes no promise of alignment.
+// Counts the allocations made through it so a hot loop can be checked to
+// be allocation-free.
+class memory_resource : public std::pmr::memory_resource {
+public:
+    // Number of successful allocations made through this resource
+    std::size_t allocations() const { return allocations_; }
+
+    // Number of bytes currently allocated through this resource
+    std::size_t bytes_in_use() const { return bytes_in_use_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        void *ptr = el_aligned_alloc(alignment, bytes);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        allocations_++;
+        bytes_in_use_ += bytes;
+        return ptr;
+    }
+
+    void do_deallocate(void *ptr, std::size_t bytes, std::size_t) override {
+        bytes_in_use_ -= bytes;
+        el_free(ptr);
+    }
+
+    // All el resources share the one el heap so memory from any of them
+    // may be freed through any other
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return dynamic_cast<const memory_resource *>(&other) != nullptr;
+    }
+
+    std::size_t allocations_ = 0;
+    std::size_t bytes_in_use_ = 0;
+};
+
+// Allocator for STL containers drawing from the el heap. Stateless, so
+// all instances compare equal.
+template <class T>
+struct allocator {
+    using value_type = T;
+
+    allocator() noexcept = default;
+
+    template <class U>
+    allocator(const allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        if (n > static_cast<std::size_t>(-1) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void *ptr = el_aligned_alloc(alignof(T), n * sizeof(T));
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(ptr);
+    }
+
+    void deallocate(T *ptr, std::size_t) noexcept {
+        el_free(ptr);
+    }
+};
+
+template <class T, class U>
+bool operator==(const allocator<T> &, const allocator<U> &) noexcept {
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const allocator<T> &, const allocator<U> &) noexcept {
+    return false;
+}
+
+// Allocate and construct a T from the el heap. The size class for T is
+// fixed at compile time so when T fits the size-class cache the
+// allocation is a pop from its bin; other types use el_aligned_alloc().
+// A bin may also hold blocks parked by C code at any address, so a block
+// not aligned for T is freed and el_aligned_alloc() used instead.
+// Throws std::bad_alloc when the heap is full.
+template <class T, class... Args>
+T *make(Args &&...args) {
+    constexpr std::size_t bin = EL_CACHE_BIN(sizeof(T));
+    void *ptr;
+    if constexpr (alignof(T) <= 8 && bin > 0 && bin < EL_CACHE_CLASSES) {
+        ptr = el_malloc_bin(bin, sizeof(T));
+        if (ptr != nullptr && reinterpret_cast<std::uintptr_t>(ptr) % alignof(T) != 0) {
+            el_free(ptr);
+            ptr = el_aligned_alloc(alignof(T), sizeof(T));
+        }
+    } else {
+        ptr = el_aligned_alloc(alignof(T), sizeof(T));
+    }
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    try {
+        return new (ptr) T(std::forward<Args>(args)...);
+    } catch (...) {
+        el_free(ptr);
+        throw;
+    }
+}
+
+// Destroy and free a T from make(). Parks the block in the size-class
+// cache so the next make<T>() reuses it.
+template <class T>
+void destroy(T *obj) {
+    if (obj == nullptr) {
+        return;
+    }
+    obj->~T();
+    if constexpr (alignof(T) <= 8) {
+        EL_FREE_CONST(static_cast<void *>(obj), sizeof(T));
+    } else {
+        el_free(obj);
+    }
+}
+
+} // namespace el
+
+#endif // EL_MALLOC_HPP
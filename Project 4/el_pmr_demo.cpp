@@ -0,0 +1,69 @@
+// el_pmr_demo.cpp: Shows the C++ adapters in el_malloc.hpp. A
+// std::pmr::vector is given an el::memory_resource and reserved up front
+// so the loop that fills it again and again makes no allocations. This
+// file can be used for testing but is not itself a test.
+
+#include <cstdio>
+#include <list>
+#include <memory_resource>
+#include <vector>
+#include "el_malloc.hpp"
+
+struct alignas(64) cache_line {
+    long value;
+};
+
+int main() {
+    el_init();
+
+    el::memory_resource resource;
+    {
+        std::pmr::vector<int> vec(&resource);
+        vec.reserve(64);
+        std::size_t before = resource.allocations();
+        for (int round = 0; round < 1000; round++) {
+            vec.clear();
+            for (int i = 0; i < 64; i++) {
+                vec.push_back(round + i);
+            }
+        }
+        std::printf("HOT LOOP\n");
+        std::printf("allocations in loop: %lu\n", resource.allocations() - before);
+        std::printf("bytes in use: %lu\n", resource.bytes_in_use());
+
+        std::pmr::vector<cache_line> lines(4, &resource);
+        std::printf("\nALIGNED\n");
+        std::printf("64-byte aligned: %s\n",
+                    reinterpret_cast<std::size_t>(lines.data()) % 64 == 0 ? "yes" : "no");
+    }
+    std::printf("bytes in use after: %lu\n", resource.bytes_in_use());
+
+    std::list<int, el::allocator<int>> nums;
+    for (int i = 0; i < 5; i++) {
+        nums.push_back(i * i);
+    }
+    struct point {
+        long x, y;
+        point(long x, long y) : x(x), y(y) {}
+    };
+    point *p = el::make<point>(3, 4);
+    el::destroy(p);
+    point *q = el::make<point>(5, 12);
+    std::printf("\nMAKE\n");
+    std::printf("reused block: %s  q: {%ld, %ld}\n", p == q ? "yes" : "no", q->x, q->y);
+    el::destroy(q);
+    el_flush_cache();
+
+    std::printf("\nLIST\n");
+    for (int n : nums) {
+        std::printf("%d ", n);
+    }
+    std::printf("\n\n");
+    el_print_stats();
+    nums.clear();
+
+    std::printf("\nFINAL\n");
+    el_print_stats();
+    el_cleanup();
+    return 0;
+}
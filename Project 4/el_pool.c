@@ -0,0 +1,235 @@
+// el_pool.c: lock-free pools of fixed-size objects built on chunks from
+// el_malloc(). Allocating and freeing work on the calling thread's
+// magazine without any atomic operations in the common case. Magazines
+// are refilled from and spilled to a shared Treiber stack, with a lock
+// only taken to add a chunk when the stack runs dry.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "el_malloc.h"
+
+// Type for the magazine of free objects each thread keeps for a pool
+typedef struct {
+  el_pool_t *pool;              // pool the objects belong to
+  int count;                    // number of objects in objs
+  void *objs[EL_POOL_MAGAZINE]; // free objects, most recently freed last
+} el_magazine_t;
+
+// Return the link stored in a free object: the offset plus one of the
+// object below it on the shared stack, or 0 at the bottom
+static uint32_t *el_pool_link(void *obj) {
+    return (uint32_t *) obj;
+}
+
+// Return the offset plus one of obj for the low half of a tagged top
+static uint32_t el_pool_offset(void *obj) {
+    return PTR_MINUS_PTR(obj, el_ctl.heap_start) + 1;
+}
+
+// Return the object at the given offset plus one
+static void *el_pool_object(uint32_t offset) {
+    return PTR_PLUS_BYTES(el_ctl.heap_start, offset - 1);
+}
+
+// Push the count objects in objs, already linked in order with objs[0]
+// on top, onto the shared stack with a single compare-and-swap.
+static void el_pool_push(el_pool_t *pool, void **objs, int count) {
+    for (int i = 0; i < count - 1; i++) {
+        *el_pool_link(objs[i]) = el_pool_offset(objs[i + 1]);
+    }
+    uint64_t top = atomic_load(&pool->top);
+    uint64_t new_top;
+    do {
+        *el_pool_link(objs[count - 1]) = (uint32_t) top;
+        new_top = ((top >> 32) + 1) << 32 | el_pool_offset(objs[0]);
+    } while (!atomic_compare_exchange_weak(&pool->top, &top, new_top));
+    atomic_fetch_add(&pool->stack_objs, count);
+}
+
+// Pop one object from the shared stack or return NULL if it is empty.
+// The link in the top object may be changed by another thread between
+// reading it and the compare-and-swap, but the tag then differs so the
+// swap fails and is retried. Chunks are never returned to the heap while
+// the pool exists so reading the link is always safe.
+static void *el_pool_pop(el_pool_t *pool) {
+    uint64_t top = atomic_load(&pool->top);
+    uint64_t new_top;
+    void *obj;
+    do {
+        if ((uint32_t) top == 0) {
+            return NULL;
+        }
+        obj = el_pool_object((uint32_t) top);
+        new_top = ((top >> 32) + 1) << 32 | *el_pool_link(obj);
+    } while (!atomic_compare_exchange_weak(&pool->top, &top, new_top));
+    atomic_fetch_sub(&pool->stack_objs, 1);
+    return obj;
+}
+
+// Allocate a chunk with el_aligned_alloc() so that objects, whose sizes
+// are multiples of 8, are 8-byte aligned, and push them onto the shared
+// stack. Only one thread adds a chunk at a time; a thread which waited
+// for the lock returns at once if the stack was refilled meanwhile.
+// Returns 0 on success or -1 if the allocation fails.
+static int el_pool_grow(el_pool_t *pool) {
+    pthread_mutex_lock(&pool->grow_lock);
+    if ((uint32_t) atomic_load(&pool->top) != 0) {
+        pthread_mutex_unlock(&pool->grow_lock);
+        return 0;
+    }
+    void **chunk = el_aligned_alloc(8, sizeof(void *) + pool->chunk_objs * pool->obj_size);
+    if (chunk == NULL) {
+        pthread_mutex_unlock(&pool->grow_lock);
+        return -1;
+    }
+    *chunk = pool->chunks;
+    pool->chunks = chunk;
+    atomic_fetch_add(&pool->chunk_count, 1);
+
+    void *objs[EL_POOL_MAGAZINE];
+    char *obj = (char *) (chunk + 1);
+    for (size_t i = 0; i < pool->chunk_objs; ) {
+        int count = 0;
+        for (; i < pool->chunk_objs && count < EL_POOL_MAGAZINE; i++, count++) {
+            objs[count] = obj + i * pool->obj_size;
+        }
+        el_pool_push(pool, objs, count);
+    }
+    pthread_mutex_unlock(&pool->grow_lock);
+    return 0;
+}
+
+// Return the objects in a thread's magazine to the shared stack when the
+// thread exits, then free the magazine.
+static void el_magazine_release(void *arg) {
+    el_magazine_t *mag = arg;
+    if (mag->count > 0) {
+        el_pool_push(mag->pool, mag->objs, mag->count);
+    }
+    free(mag);
+}
+
+// Return the calling thread's magazine for pool, creating it on first
+// use, or NULL if one can't be allocated.
+static el_magazine_t *el_pool_magazine(el_pool_t *pool) {
+    el_magazine_t *mag = pthread_getspecific(pool->magazine_key);
+    if (mag == NULL) {
+        mag = calloc(1, sizeof(el_magazine_t));
+        if (mag == NULL) {
+            return NULL;
+        }
+        mag->pool = pool;
+        pthread_setspecific(pool->magazine_key, mag);
+    }
+    return mag;
+}
+
+// Initialize pool to hand out 8-byte aligned objects of obj_size bytes,
+// rounded up to a multiple of 8, carved chunk_objs at a time from
+// el_aligned_alloc(). Enables locking in el_malloc() as chunks may be
+// added from any thread. Objects are addressed by 32-bit offsets so the
+// heap must be under 4GB. Returns 0 on success or -1 on failure.
+int el_pool_init(el_pool_t *pool, size_t obj_size, size_t chunk_objs) {
+    if (obj_size == 0 || chunk_objs == 0) {
+        fprintf(stderr,"el_pool_init: object size and objects per chunk must be positive\n");
+        return -1;
+    }
+    if (pthread_key_create(&pool->magazine_key, el_magazine_release) != 0) {
+        return -1;
+    }
+    el_enable_locking();
+    pool->obj_size = (obj_size + 7) / 8 * 8;
+    pool->chunk_objs = chunk_objs;
+    atomic_init(&pool->top, 0);
+    atomic_init(&pool->chunk_count, 0);
+    atomic_init(&pool->stack_objs, 0);
+    pthread_mutex_init(&pool->grow_lock, NULL);
+    pool->chunks = NULL;
+    return 0;
+}
+
+// Free all chunks of pool back to the heap. Every object must have been
+// returned and every other thread that used the pool must have exited;
+// the calling thread's magazine is discarded.
+void el_pool_destroy(el_pool_t *pool) {
+    el_magazine_t *mag = pthread_getspecific(pool->magazine_key);
+    free(mag);
+    pthread_setspecific(pool->magazine_key, NULL);
+    pthread_key_delete(pool->magazine_key);
+    while (pool->chunks != NULL) {
+        void **chunk = pool->chunks;
+        pool->chunks = *chunk;
+        el_free(chunk);
+    }
+    pthread_mutex_destroy(&pool->grow_lock);
+    atomic_store(&pool->top, 0);
+    atomic_store(&pool->chunk_count, 0);
+    atomic_store(&pool->stack_objs, 0);
+}
+
+// Allocate an object from pool. Taken from the thread's magazine when it
+// is not empty, which involves no atomic operations. Otherwise the
+// magazine is refilled with up to half its capacity from the shared
+// stack, adding a chunk first if the stack is empty. Returns NULL if no
+// chunk can be allocated.
+void *el_pool_alloc(el_pool_t *pool) {
+    el_magazine_t *mag = el_pool_magazine(pool);
+    if (mag == NULL) {
+        return NULL;
+    }
+    if (mag->count > 0) {
+        return mag->objs[--mag->count];
+    }
+    while (mag->count < EL_POOL_MAGAZINE / 2) {
+        void *obj = el_pool_pop(pool);
+        if (obj == NULL) {
+            if (mag->count > 0 || el_pool_grow(pool) != 0) {
+                break;
+            }
+            continue;
+        }
+        mag->objs[mag->count++] = obj;
+    }
+    if (mag->count == 0) {
+        return NULL;
+    }
+    return mag->objs[--mag->count];
+}
+
+// Return obj to pool. Goes into the thread's magazine; when that is full
+// the older half of it is pushed onto the shared stack first so other
+// threads can use the objects.
+void el_pool_free(el_pool_t *pool, void *obj) {
+    if (obj == NULL) {
+        return;
+    }
+    el_magazine_t *mag = el_pool_magazine(pool);
+    if (mag == NULL) {
+        el_pool_push(pool, &obj, 1);
+        return;
+    }
+    if (mag->count == EL_POOL_MAGAZINE) {
+        int half = EL_POOL_MAGAZINE / 2;
+        el_pool_push(pool, mag->objs, half);
+        for (int i = half; i < EL_POOL_MAGAZINE; i++) {
+            mag->objs[i - half] = mag->objs[i];
+        }
+        mag->count -= half;
+    }
+    mag->objs[mag->count++] = obj;
+}
+
+// Print the size and chunk counts of pool along with the free objects on
+// the shared stack and in the calling thread's magazine. The format
+// appears as follows.
+//
+// POOL: {obj_size: 24  chunk_objs: 8  chunks: 2  objects: 16}
+//   free: {stack: 10  magazine: 4}
+void el_pool_print_stats(el_pool_t *pool) {
+    el_magazine_t *mag = pthread_getspecific(pool->magazine_key);
+    size_t chunks = atomic_load(&pool->chunk_count);
+    printf("POOL: {obj_size: %lu  chunk_objs: %lu  chunks: %lu  objects: %lu}\n",
+           pool->obj_size, pool->chunk_objs, chunks, chunks * pool->chunk_objs);
+    printf("  free: {stack: %lu  magazine: %d}\n", atomic_load(&pool->stack_objs),
+           mag != NULL ? mag->count : 0);
+}
@@ -0,0 +1,257 @@
+// el_profile.c: sampling heap profiler for el_malloc(). While running,
+// the call stack of about one allocation per sample_bytes allocated is
+// recorded along with the sampled object. Samples stay in a table until
+// the object is el_free()'d so that el_dump_profile() can attribute the
+// memory still live to the call sites that allocated it.
+
+#include <execinfo.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "el_malloc.h"
+
+#define EL_PROFILE_DEPTH    16   // frames recorded for each sample
+#define EL_PROFILE_SKIP     2    // frames for el_profile_malloc()/el_malloc() left out
+#define EL_PROFILE_BUCKETS  4096 // buckets in the sample and site hash tables
+
+// Type for a call site: a unique stack of return addresses along with
+// the estimated memory allocated from it.
+typedef struct el_site {
+  void *frames[EL_PROFILE_DEPTH]; // return addresses, innermost first
+  int depth;                    // number of frames used
+  unsigned long hash;           // hash of the frames
+  double live_bytes;            // estimated bytes allocated here and not yet freed
+  size_t live_samples;          // samples from here not yet freed
+  double total_bytes;           // estimated bytes ever allocated here
+  struct el_site *next;         // next site in the same bucket
+} el_site_t;
+
+// Type for a sampled object which is still live
+typedef struct el_sample {
+  void *ptr;                    // object returned by el_malloc()
+  el_site_t *site;              // where it was allocated
+  double weight;                // estimated bytes of allocation this sample stands for
+  struct el_sample *next;       // next sample in the same bucket
+} el_sample_t;
+
+// State of the profiler, pointed to by el_ctl.profile while running
+struct el_profile {
+  size_t sample_bytes;          // mean number of bytes allocated between samples
+  long countdown;               // bytes left to allocate before the next sample
+  uint64_t rng;                 // xorshift state for sample intervals
+  el_sample_t *samples[EL_PROFILE_BUCKETS]; // live samples hashed by pointer
+  el_site_t *sites[EL_PROFILE_BUCKETS];     // call sites hashed by stack
+  size_t site_count;            // number of distinct call sites
+  size_t live_samples;          // number of samples not yet freed
+};
+
+// Return the bucket for ptr in the table of live samples
+static size_t el_profile_bucket(void *ptr) {
+    return (((uintptr_t) ptr >> 4) * 0x9E3779B97F4A7C15UL) >> 52;
+}
+
+// Return the number of bytes to allocate before the next sample. Drawn
+// from an exponential distribution with mean sample_bytes so samples
+// form a Poisson process over allocated bytes and every byte has the same
+// chance of being sampled whatever the sizes of the allocations.
+static long el_profile_interval(struct el_profile *prof) {
+    prof->rng ^= prof->rng << 13;
+    prof->rng ^= prof->rng >> 7;
+    prof->rng ^= prof->rng << 17;
+    double u = ((prof->rng >> 11) + 1) * (1.0 / 9007199254740992.0); // in (0,1]
+    long interval = (long) (-log(u) * prof->sample_bytes);
+    return interval > 0 ? interval : 1;
+}
+
+// Return the site for the given stack, adding it if it is new. Returns
+// NULL if a new site can't be allocated.
+static el_site_t *el_profile_site(struct el_profile *prof, void **frames, int depth) {
+    unsigned long hash = 14695981039346656037UL;
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ (uintptr_t) frames[i]) * 1099511628211UL;
+    }
+    el_site_t **bucket = &prof->sites[hash % EL_PROFILE_BUCKETS];
+    for (el_site_t *site = *bucket; site != NULL; site = site->next) {
+        if (site->hash == hash && site->depth == depth) {
+            int same = 1;
+            for (int i = 0; i < depth && same; i++) {
+                same = site->frames[i] == frames[i];
+            }
+            if (same) {
+                return site;
+            }
+        }
+    }
+
+    el_site_t *site = calloc(1, sizeof(el_site_t));
+    if (site == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < depth; i++) {
+        site->frames[i] = frames[i];
+    }
+    site->depth = depth;
+    site->hash = hash;
+    site->next = *bucket;
+    *bucket = site;
+    prof->site_count++;
+    return site;
+}
+
+// Start profiling with one sample per sample_bytes allocated on
+// average. Returns 0 on success or -1 if the profiler is already running,
+// sample_bytes is 0 or memory for the profiler can't be allocated.
+int el_profile_start(size_t sample_bytes) {
+    if (el_ctl.profile != NULL || sample_bytes == 0) {
+        return -1;
+    }
+    struct el_profile *prof = calloc(1, sizeof(struct el_profile));
+    if (prof == NULL) {
+        return -1;
+    }
+    prof->sample_bytes = sample_bytes;
+    prof->rng = ((uint64_t) time(NULL) << 20) ^ getpid() ^ 0x2545F4914F6CDD1DUL;
+    prof->countdown = el_profile_interval(prof);
+    el_ctl.profile = prof;
+    return 0;
+}
+
+// Stop profiling and discard all samples and sites.
+void el_profile_stop() {
+    struct el_profile *prof = el_ctl.profile;
+    if (prof == NULL) {
+        return;
+    }
+    for (int b = 0; b < EL_PROFILE_BUCKETS; b++) {
+        while (prof->samples[b] != NULL) {
+            el_sample_t *sample = prof->samples[b];
+            prof->samples[b] = sample->next;
+            free(sample);
+        }
+        while (prof->sites[b] != NULL) {
+            el_site_t *site = prof->sites[b];
+            prof->sites[b] = site->next;
+            free(site);
+        }
+    }
+    free(prof);
+    el_ctl.profile = NULL;
+}
+
+// Called by el_malloc() for every successful allocation while profiling.
+// Most calls only count down the bytes until the next sample. When the
+// count runs out, the stack is recorded and ptr is added to the live
+// samples with the weight of allocation it stands for: an object of s
+// bytes is sampled with probability 1-exp(-s/sample_bytes) so it stands
+// for s/(1-exp(-s/sample_bytes)) bytes.
+void el_profile_malloc(void *ptr, size_t nbytes) {
+    struct el_profile *prof = el_ctl.profile;
+    prof->countdown -= (long) nbytes;
+    if (prof->countdown > 0) {
+        return;
+    }
+    prof->countdown = el_profile_interval(prof);
+
+    void *frames[EL_PROFILE_DEPTH + EL_PROFILE_SKIP];
+    int depth = backtrace(frames, EL_PROFILE_DEPTH + EL_PROFILE_SKIP);
+    int skip = depth > EL_PROFILE_SKIP ? EL_PROFILE_SKIP : 0;
+    el_site_t *site = el_profile_site(prof, frames + skip, depth - skip);
+    el_sample_t *sample = malloc(sizeof(el_sample_t));
+    if (site == NULL || sample == NULL) {
+        free(sample);
+        return;
+    }
+
+    double s = nbytes > 0 ? (double) nbytes : 1.0;
+    sample->ptr = ptr;
+    sample->site = site;
+    sample->weight = s / (1.0 - exp(-s / prof->sample_bytes));
+    size_t b = el_profile_bucket(ptr);
+    sample->next = prof->samples[b];
+    prof->samples[b] = sample;
+    prof->live_samples++;
+    site->live_bytes += sample->weight;
+    site->live_samples++;
+    site->total_bytes += sample->weight;
+}
+
+// Called by el_free() while profiling. Removes the sample for ptr, if it
+// was sampled, from the live samples and its site.
+void el_profile_free(void *ptr) {
+    struct el_profile *prof = el_ctl.profile;
+    el_sample_t **link = &prof->samples[el_profile_bucket(ptr)];
+    while (*link != NULL && (*link)->ptr != ptr) {
+        link = &(*link)->next;
+    }
+    el_sample_t *sample = *link;
+    if (sample == NULL) {
+        return;
+    }
+    *link = sample->next;
+    prof->live_samples--;
+    sample->site->live_bytes -= sample->weight;
+    sample->site->live_samples--;
+    free(sample);
+}
+
+// Order sites by decreasing live bytes for el_dump_profile()
+static int el_site_cmp(const void *a, const void *b) {
+    double x = (*(el_site_t **) a)->live_bytes;
+    double y = (*(el_site_t **) b)->live_bytes;
+    return (x < y) - (x > y);
+}
+
+// Write the estimated live bytes for each call site with live samples,
+// largest first, followed by the stack of the site. The output format
+// resembles the following.
+//
+// HEAP PROFILE (sample every 4096 bytes)
+// live: 12800 bytes in 6 samples from 2 sites
+// [  0] 8960 bytes live in 4 samples (9216 bytes allocated)
+//         ./test_el_malloc(+0x2a51) [0x55d0c6c00a51]
+//         ...
+void el_dump_profile(FILE *out) {
+    struct el_profile *prof = el_ctl.profile;
+    if (prof == NULL) {
+        fprintf(out, "HEAP PROFILE: not running\n");
+        return;
+    }
+
+    el_site_t **live = malloc((prof->site_count + 1) * sizeof(el_site_t *));
+    if (live == NULL) {
+        return;
+    }
+    size_t nlive = 0;
+    double live_bytes = 0;
+    for (int b = 0; b < EL_PROFILE_BUCKETS; b++) {
+        for (el_site_t *site = prof->sites[b]; site != NULL; site = site->next) {
+            if (site->live_samples > 0) {
+                live[nlive++] = site;
+                live_bytes += site->live_bytes;
+            }
+        }
+    }
+    qsort(live, nlive, sizeof(el_site_t *), el_site_cmp);
+
+    fprintf(out, "HEAP PROFILE (sample every %lu bytes)\n", prof->sample_bytes);
+    fprintf(out, "live: %.0f bytes in %lu samples from %lu sites\n",
+            live_bytes, prof->live_samples, nlive);
+    for (size_t i = 0; i < nlive; i++) {
+        el_site_t *site = live[i];
+        fprintf(out, "[%3lu] %.0f bytes live in %lu samples (%.0f bytes allocated)\n",
+                i, site->live_bytes, site->live_samples, site->total_bytes);
+        char **symbols = backtrace_symbols(site->frames, site->depth);
+        for (int f = 0; f < site->depth; f++) {
+            if (symbols != NULL) {
+                fprintf(out, "        %s\n", symbols[f]);
+            } else {
+                fprintf(out, "        %p\n", site->frames[f]);
+            }
+        }
+        free(symbols);
+    }
+    free(live);
+}
@@ -1,8 +1,13 @@
 // el_malloc.c test program
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include "el_malloc.h"
 
 #define HEAP_SIZE 1024
@@ -26,14 +31,227 @@ void print_ptrs(void *ptr[], int len) {
     }
 }
 
+// Blocks held by the test pressure callback and released on request
+void *pressure_cache[8];
+int pressure_cached = 0;
+
+// Pressure callback for tests: frees every cached block and reports the
+// bytes released
+size_t release_pressure_cache(int level, size_t nbytes, void *arg) {
+    size_t released = 0;
+    printf("pressure level %d for %lu bytes: releasing %d blocks\n",
+           level, nbytes, pressure_cached);
+    while (pressure_cached > 0) {
+        void *ptr = pressure_cache[--pressure_cached];
+        released += el_malloc_usable_size(ptr);
+        el_free(ptr);
+    }
+    return released;
+}
+
+// Thread body for pool tests: repeatedly allocates a batch of objects
+// from the pool, writes to them and frees them again
+void *churn_pool(void *arg) {
+    el_pool_t *pool = arg;
+    void *objs[40];
+    for (int round = 0; round < 2000; round++) {
+        int count = round % 40 + 1;
+        for (int i = 0; i < count; i++) {
+            objs[i] = el_pool_alloc(pool);
+            memset(objs[i], round, pool->obj_size);
+        }
+        for (int i = 0; i < count; i++) {
+            el_pool_free(pool, objs[i]);
+        }
+    }
+    return NULL;
+}
+
+#define STRESS_SLOTS    128     // most live allocations during a stress run
+#define STRESS_MAX_SIZE 256     // largest request made during a stress run
+
+// Return the next number from a xorshift generator for stress runs
+unsigned long stress_rand(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Return the microseconds elapsed since start
+double elapsed_us(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+// Walk the heap from heap_start with el_block_above() checking that each
+// block has a valid state and a footer matching its header, that no two
+// available blocks are adjacent, that the blocks exactly fill the heap
+// and that the lengths and byte counts of the lists match the walk.
+// Prints the first problem found and returns 0 if there is one, 1
+// otherwise.
+int check_heap(long op) {
+    size_t avail = 0, used = 0, quarantined = 0, avail_bytes = 0, used_bytes = 0, total = 0;
+    int below_avail = 0;
+    el_blockhead_t *block = el_ctl.heap_start;
+    while (block != NULL) {
+        if (block->state != EL_AVAILABLE && block->state != EL_USED &&
+            block->state != EL_QUARANTINED) {
+            printf("op %ld: block %p has bad state %d\n", op, block, block->state);
+            return 0;
+        }
+        if (el_get_footer(block)->size != block->size) {
+            printf("op %ld: block %p size %lu but footer says %lu\n",
+                   op, block, block->size, el_get_footer(block)->size);
+            return 0;
+        }
+        if (block->state == EL_AVAILABLE) {
+            if (below_avail) {
+                printf("op %ld: available block %p was not merged with the one below\n",
+                       op, block);
+                return 0;
+            }
+            avail++;
+            avail_bytes += block->size + EL_BLOCK_OVERHEAD;
+        }
+        else if (block->state == EL_USED) {
+            used++;
+            used_bytes += block->size + EL_BLOCK_OVERHEAD;
+        }
+        else {
+            quarantined++;
+        }
+        below_avail = block->state == EL_AVAILABLE;
+        total += block->size + EL_BLOCK_OVERHEAD;
+        block = el_block_above(block);
+    }
+    if (total != el_ctl.heap_bytes) {
+        printf("op %ld: blocks cover %lu bytes of a %lu byte heap\n", op, total, el_ctl.heap_bytes);
+        return 0;
+    }
+    if (avail != el_ctl.avail->length || avail_bytes != el_ctl.avail->bytes ||
+        used != el_ctl.used->length || used_bytes != el_ctl.used->bytes) {
+        printf("op %ld: walk found %lu/%lu available and %lu/%lu used blocks/bytes but lists "
+               "have %lu/%lu and %lu/%lu\n", op, avail, avail_bytes, used, used_bytes,
+               el_ctl.avail->length, el_ctl.avail->bytes, el_ctl.used->length, el_ctl.used->bytes);
+        return 0;
+    }
+    if (el_ctl.quarantine.list != NULL && quarantined != el_ctl.quarantine.list->length) {
+        printf("op %ld: walk found %lu quarantined blocks but list has %lu\n",
+               op, quarantined, el_ctl.quarantine.list->length);
+        return 0;
+    }
+    return 1;
+}
+
+// Run ops random el_malloc()/el_free() operations from a generator
+// seeded with seed, checking the heap with check_heap() every check_every
+// operations. Each live block is filled with a byte derived from its slot
+// and verified when freed to catch blocks that overlap. A non-zero limit
+// is passed to el_set_limit() so the heap can grow; with 0 the heap stays
+// at its initial size and many allocations fail. A non-zero quarantine
+// is passed to el_set_quarantine() to measure its cost. Reports operations
+// per second, leaving out the time spent checking, and the longest heap
+// walk. Returns 0 if all checks pass, 1 otherwise.
+int run_stress(long ops, unsigned long seed, long check_every, size_t limit,
+               size_t quarantine) {
+    el_init();
+    if (limit > 0 && el_set_limit(limit) != 0) {
+        return 1;
+    }
+    if (quarantine > 0 && el_set_quarantine(quarantine) != 0) {
+        return 1;
+    }
+    void *slots[STRESS_SLOTS] = {};
+    size_t sizes[STRESS_SLOTS] = {};
+    unsigned long rng = seed != 0 ? seed : 1;
+    long mallocs = 0, frees = 0, failures = 0, checks = 0;
+    double op_us = 0, max_check_us = 0;
+    int ok = 1;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long op = 1; op <= ops && ok; op++) {
+        int slot = stress_rand(&rng) % STRESS_SLOTS;
+        if (slots[slot] == NULL) {
+            size_t size = stress_rand(&rng) % STRESS_MAX_SIZE + 1;
+            slots[slot] = el_malloc(size);
+            if (slots[slot] == NULL) {
+                failures++;
+            }
+            else {
+                memset(slots[slot], slot, size);
+                sizes[slot] = size;
+                mallocs++;
+            }
+        }
+        else {
+            unsigned char *bytes = slots[slot];
+            for (size_t i = 0; i < sizes[slot] && ok; i++) {
+                if (bytes[i] != (unsigned char) slot) {
+                    printf("op %ld: byte %lu of slot %d overwritten\n", op, i, slot);
+                    ok = 0;
+                }
+            }
+            el_free(slots[slot]);
+            slots[slot] = NULL;
+            frees++;
+        }
+
+        if (op % check_every == 0) {
+            op_us += elapsed_us(&start);
+            struct timespec check_start;
+            clock_gettime(CLOCK_MONOTONIC, &check_start);
+            ok = ok && check_heap(op);
+            double check_us = elapsed_us(&check_start);
+            if (check_us > max_check_us) {
+                max_check_us = check_us;
+            }
+            checks++;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+    }
+    op_us += elapsed_us(&start);
+
+    for (int slot = 0; slot < STRESS_SLOTS; slot++) {
+        el_free(slots[slot]);
+    }
+    el_set_quarantine(0);
+    ok = ok && check_heap(ops) && el_ctl.avail->length == 1;
+
+    printf("STRESS: {ops: %ld  seed: %lu  check every: %ld  quarantine: %lu}\n",
+           ops, seed, check_every, quarantine);
+    printf("  mallocs: %ld  frees: %ld  failed mallocs: %ld  heap bytes: %lu\n",
+           mallocs, frees, failures, el_ctl.heap_bytes);
+    printf("  ops/sec: %.0f\n", (mallocs + frees + failures) / (op_us / 1e6));
+    printf("  heap checks: %ld  longest: %.1f us\n", checks, max_check_us);
+    printf("  result: %s\n", ok ? "ok" : "FAILED");
+#ifdef EL_LATENCY
+    el_print_latency();
+#endif
+    el_cleanup();
+    return ok ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 2) {
         printf("Usage: %s <test_name>\n", argv[0]);
+        printf("       %s --stress [ops] [seed] [check_every] [limit] [quarantine]\n", argv[0]);
         return 1;
     }
     char *test_name = argv[1];
     char sysbuf[1024];
 
+    if (strcmp(test_name, "--stress") == 0) {
+        long ops = argc > 2 ? atol(argv[2]) : 2000000;
+        unsigned long seed = argc > 3 ? strtoul(argv[3], NULL, 10) : 1;
+        long check_every = argc > 4 ? atol(argv[4]) : 1000;
+        size_t limit = argc > 5 ? strtoul(argv[5], NULL, 10) : 65536;
+        size_t quarantine = argc > 6 ? strtoul(argv[6], NULL, 10) : 0;
+        return run_stress(ops, seed, check_every > 0 ? check_every : 1, limit, quarantine);
+    }
+
     el_init(HEAP_SIZE);
 
     if (strcmp(test_name, "Single Allocation") == 0) {
@@ -509,6 +727,587 @@ int main(int argc, char *argv[]) {
         print_ptrs(ptr, len);
     } // ENDTEST
 
+    else if (strcmp(test_name, "Persistent Heap") == 0) {
+        PRINT_TEST;
+        // Replaces the default heap with a file-backed heap, allocates
+        // some blocks and closes it. Re-opening the file should restore
+        // the same heap with the same contents in the blocks.
+
+        el_cleanup();
+        unlink("test-persistent.heap");
+        el_open("test-persistent.heap");
+
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(128);
+        ptr[len++] = el_malloc(200);
+        ptr[len++] = el_malloc(64);
+        strcpy(ptr[1], "survives el_cleanup()");
+        el_free(ptr[0]);
+        printf("BEFORE CLOSE\n");
+        el_print_stats();
+        printf("\n");
+        el_cleanup();
+
+        el_open("test-persistent.heap");
+        printf("AFTER OPEN\n");
+        el_print_stats();
+        printf("\n");
+        printf("ptr[1] contents: %s\n", (char *) ptr[1]);
+
+        ptr[len++] = el_malloc(100);
+        printf("\nMALLOC 3\n");
+        el_print_stats();
+        printf("\n");
+        printf("POINTERS\n");
+        print_ptrs(ptr, len);
+        unlink("test-persistent.heap");
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Shared Heap") == 0) {
+        PRINT_TEST;
+        // Replaces the default heap with one in shared memory. A child
+        // process opens the same heap, reads a message left by the parent
+        // using its offset, frees it and leaves a reply which the parent
+        // then reads and frees.
+
+        el_cleanup();
+        shm_unlink("/test_el_malloc_shared");
+        el_shm_open("/test_el_malloc_shared", HEAP_SIZE);
+
+        char *msg = el_malloc(64);
+        strcpy(msg, "hello from parent");
+        long msg_off = el_ptr_to_offset(msg);
+        printf("BEFORE FORK\n");
+        el_print_stats();
+        printf("\n");
+        fflush(stdout);
+
+        long reply_off = -1;
+        int pipefd[2];
+        assert(pipe(pipefd) == 0);
+        pid_t child = fork();
+        if (child == 0) {
+            el_cleanup();
+            el_shm_open("/test_el_malloc_shared", HEAP_SIZE);
+            printf("CHILD READS: %s\n", (char *) el_offset_to_ptr(msg_off));
+            el_free(el_offset_to_ptr(msg_off));
+            char *reply = el_malloc(32);
+            strcpy(reply, "hello from child");
+            reply_off = el_ptr_to_offset(reply);
+            assert(write(pipefd[1], &reply_off, sizeof(reply_off)) == sizeof(reply_off));
+            el_cleanup();
+            fflush(stdout);
+            _exit(0);
+        }
+        assert(read(pipefd[0], &reply_off, sizeof(reply_off)) == sizeof(reply_off));
+        waitpid(child, NULL, 0);
+
+        printf("\nAFTER CHILD\n");
+        el_print_stats();
+        printf("\n");
+        printf("PARENT READS: %s\n", (char *) el_offset_to_ptr(reply_off));
+        el_free(el_offset_to_ptr(reply_off));
+
+        printf("\nAFTER FREE\n");
+        el_print_stats();
+        printf("\n");
+        shm_unlink("/test_el_malloc_shared");
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Compact Handles") == 0) {
+        PRINT_TEST;
+        // Allocates movable blocks through handles around a block from
+        // el_malloc() then frees some to leave holes. el_compact() should
+        // slide the unlocked handle blocks down, keep the el_malloc()'d
+        // and locked blocks in place and preserve block contents.
+
+        el_handle_t h[4];
+        h[0] = el_halloc(128);
+        h[1] = el_halloc(200);
+        void *fixed = el_malloc(64);
+        h[2] = el_halloc(300);
+        h[3] = el_halloc(100);
+        for (int i = 0; i < 4; i++) {
+            sprintf(el_hlock(h[i]), "handle %d", i);
+            el_hunlock(h[i]);
+        }
+
+        el_hfree(h[0]);
+        el_hfree(h[2]);
+        printf("BEFORE COMPACT\n");
+        el_print_stats();
+        printf("\n");
+
+        el_hlock(h[3]);
+        printf("moved: %lu\n", el_compact());
+        printf("\nAFTER COMPACT, 3 LOCKED\n");
+        el_print_stats();
+        printf("\n");
+
+        el_hunlock(h[3]);
+        el_free(fixed);
+        printf("moved: %lu\n", el_compact());
+        printf("\nAFTER COMPACT\n");
+        el_print_stats();
+        printf("\n");
+
+        printf("POINTERS\n");
+        print_ptr("h[1]", el_hlock(h[1]));
+        print_ptr("h[3]", el_hlock(h[3]));
+        printf("h[1]: %s\n", (char *) el_hlock(h[1]));
+        printf("h[3]: %s\n", (char *) el_hlock(h[3]));
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Sized Free") == 0) {
+        PRINT_TEST;
+        // Frees blocks with el_free_sized() which parks them in the
+        // size-class cache rather than merging them. Later allocations of
+        // similar size reuse them directly. Also checks that a block too
+        // small to split is handed out whole with its extra bytes usable.
+
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(64);
+        ptr[len++] = el_malloc(64);
+        ptr[len++] = el_malloc(100);
+        el_free_sized(ptr[0], 64);
+        el_free_sized(ptr[2], 100);
+        printf("AFTER SIZED FREE 0,2\n");
+        el_print_stats();
+        printf("\n");
+
+        ptr[len++] = el_malloc(60);
+        ptr[len++] = el_malloc(64);
+        printf("MALLOC 3,4\n");
+        el_print_stats();
+        printf("\n");
+        printf("POINTERS\n");
+        print_ptrs(ptr, len);
+
+        el_flush_cache();
+        printf("\nAFTER FLUSH\n");
+        el_print_stats();
+        printf("\n");
+
+        ptr[len++] = el_malloc(3000);
+        ptr[len++] = el_malloc(500);
+        printf("MALLOC 5,6\n");
+        el_print_stats();
+        printf("\n");
+        printf("usable size 5: %lu\n", el_malloc_usable_size(ptr[5]));
+        printf("usable size 6: %lu\n", el_malloc_usable_size(ptr[6]));
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Avail Index") == 0) {
+        PRINT_TEST;
+        // Turns on the available index and repeats allocations/frees
+        // that split and merge blocks. Searches through the index must
+        // pick the same blocks as walking the available list so results
+        // should match those of the same calls without the index.
+
+        el_use_avail_index(1);
+
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(128);
+        ptr[len++] = el_malloc(200);
+        ptr[len++] = el_malloc(64);
+        ptr[len++] = el_malloc(312);
+        el_free(ptr[0]);
+        el_free(ptr[2]);
+        printf("MALLOC 0-3, FREE 0,2\n");
+        el_print_stats();
+        printf("\n");
+
+        ptr[len++] = el_malloc(100);
+        ptr[len++] = el_malloc(20);
+        ptr[len++] = el_malloc(16);
+        printf("MALLOC 4-6\n");
+        el_print_stats();
+        printf("\n");
+        printf("POINTERS\n");
+        print_ptrs(ptr, len);
+
+        el_free(ptr[1]);
+        el_free(ptr[5]);
+        el_free(ptr[3]);
+        printf("\nFREE 1,5,3\n");
+        el_print_stats();
+        printf("\n");
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Buddy Backend") == 0) {
+        PRINT_TEST;
+        // Switches to the buddy backend and allocates blocks of several
+        // sizes which are rounded up to powers of two by splitting the
+        // whole heap. Freeing them all should merge buddies back into a
+        // single block covering the heap.
+
+        el_cleanup();
+        el_set_backend(EL_BACKEND_BUDDY);
+        el_init();
+
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(100);
+        ptr[len++] = el_malloc(30);
+        ptr[len++] = el_malloc(500);
+        ptr[len++] = el_malloc(1000);
+        printf("MALLOC 0-3\n");
+        el_print_stats();
+        printf("\n");
+        printf("POINTERS\n");
+        print_ptrs(ptr, len);
+        printf("usable size 0: %lu\n", el_malloc_usable_size(ptr[0]));
+
+        ptr[len++] = el_malloc(3000);
+        printf("\nMALLOC 4\n");
+        printf("POINTERS\n");
+        print_ptrs(ptr, len);
+        printf("should be (nil)\n");
+
+        el_free(ptr[1]);
+        el_free(ptr[3]);
+        printf("\nFREE 1,3\n");
+        el_print_stats();
+        printf("\n");
+
+        el_free(ptr[0]);
+        el_free(ptr[2]);
+        printf("FREE 0,2\n");
+        el_print_stats();
+        printf("\n");
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Heap Profile") == 0) {
+        PRINT_TEST;
+        // Profiles with a sampling interval of 1 byte so that every
+        // allocation is sampled with a weight of its own size. Frees
+        // should remove samples so only live bytes are reported. Only the
+        // summary of the profile is shown as the stacks vary by build.
+
+        el_profile_start(1);
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(128);
+        ptr[len++] = el_malloc(200);
+        ptr[len++] = el_malloc(64);
+        el_free(ptr[1]);
+
+        char line[256];
+        FILE *prof = tmpfile();
+        el_dump_profile(prof);
+        rewind(prof);
+        for (int i = 0; i < 3 && fgets(line, sizeof(line), prof) != NULL; i++) {
+            if (line[0] != ' ') {
+                printf("%s", line);
+            }
+        }
+        fclose(prof);
+        el_profile_stop();
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Maintenance Thread") == 0) {
+        PRINT_TEST;
+        // Starts the maintenance thread with a period long enough that it
+        // never wakes during the test. Frees are then deferred and the
+        // blocks stay used until el_maintain() is run by hand, which
+        // should release and coalesce them all.
+
+        el_start_maintenance(1000000, 0);
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(128);
+        ptr[len++] = el_malloc(200);
+        ptr[len++] = el_malloc(64);
+        el_free(ptr[0]);
+        el_free(ptr[1]);
+
+        printf("\nDEFERRED FREES\n");
+        printf("deferred: %lu\n", el_ctl.deferred_count);
+        el_print_stats();
+
+        el_maintain(0);
+        printf("\nAFTER MAINTENANCE\n");
+        printf("deferred: %lu  released: %lu  cycles: %lu\n",
+               el_ctl.deferred_count, el_ctl.maint.released, el_ctl.maint.cycles);
+        el_print_stats();
+
+        el_free(ptr[2]);
+        el_stop_maintenance();
+        printf("\nAFTER STOP\n");
+        printf("deferred: %lu  released: %lu\n",
+               el_ctl.deferred_count, el_ctl.maint.released);
+        el_print_stats();
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Memory Limit") == 0) {
+        PRINT_TEST;
+        // Sets a limit of 2 pages and keeps a cache of blocks that the
+        // pressure callback releases. A request too large for the heap
+        // runs the callback before the heap grows, crossing the
+        // high-water mark runs it again and a request past the limit
+        // fails.
+
+        el_set_limit(2 * 4096);
+        el_on_pressure(release_pressure_cache, NULL);
+        void *ptr[16] = {};
+        int len = 0;
+
+        for (int i = 0; i < 4; i++) {
+            pressure_cache[pressure_cached++] = el_malloc(400);
+        }
+        ptr[len++] = el_malloc(2000);
+
+        printf("\nGROW FOR 3000 BYTES\n");
+        ptr[len++] = el_malloc(3000);
+        printf("total_bytes: %lu\n", el_ctl.heap_bytes);
+
+        printf("\nCROSS HIGH-WATER MARK\n");
+        for (int i = 0; i < 2; i++) {
+            pressure_cache[pressure_cached++] = el_malloc(400);
+        }
+        ptr[len++] = el_malloc(1200);
+
+        printf("\nPAST THE LIMIT\n");
+        ptr[len++] = el_malloc(9000);
+        print_ptrs(ptr, len);
+        el_print_limit();
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Object Pool") == 0) {
+        PRINT_TEST;
+        // Creates a pool of 20-byte objects, rounded up to 24, carved 8
+        // at a time. Allocating 10 objects needs 2 chunks. Freed objects
+        // go to this thread's magazine. Four threads then churn the pool;
+        // when they exit their magazines return to the shared stack so
+        // every object is free again.
+
+        el_pool_t pool;
+        el_pool_init(&pool, 20, 8);
+        void *ptr[16] = {};
+        int len = 0;
+
+        for (int i = 0; i < 10; i++) {
+            ptr[len++] = el_pool_alloc(&pool);
+        }
+        print_ptrs(ptr, len);
+        el_pool_print_stats(&pool);
+        for (int i = 0; i < len; i++) {
+            el_pool_free(&pool, ptr[i]);
+        }
+        el_pool_print_stats(&pool);
+
+        pthread_t threads[4];
+        for (int i = 0; i < 4; i++) {
+            pthread_create(&threads[i], NULL, churn_pool, &pool);
+        }
+        for (int i = 0; i < 4; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        size_t objects = atomic_load(&pool.chunk_count) * pool.chunk_objs;
+        size_t free_objs = atomic_load(&pool.stack_objs) + 16; // 16 in this magazine
+        printf("\nAFTER THREADS\n");
+        printf("all objects free: %s\n", objects == free_objs ? "yes" : "no");
+        el_pool_destroy(&pool);
+        el_print_stats();
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Aligned Alloc") == 0) {
+        PRINT_TEST;
+        // Allocates blocks aligned to 64 and 256 bytes. The space below
+        // each aligned payload is split off as a block and freed so it
+        // shows in the available list. Freeing the aligned blocks should
+        // restore a single available block.
+
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(24);
+        ptr[len++] = el_aligned_alloc(64, 100);
+        ptr[len++] = el_aligned_alloc(256, 200);
+        print_ptrs(ptr, len);
+        printf("aligned: %d %d\n", (size_t) ptr[1] % 64 == 0, (size_t) ptr[2] % 256 == 0);
+        el_print_stats();
+
+        for (int i = 0; i < len; i++) {
+            el_free(ptr[i]);
+        }
+        printf("\nFREE ALL\n");
+        el_print_stats();
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Latency Histogram") == 0) {
+        PRINT_TEST;
+        // Records the values 1 to 1000 in a histogram. Values are kept
+        // to within an eighth of themselves so percentiles are reported
+        // as the top of the bucket holding them, never above the max.
+
+        el_histogram_t hist = {};
+        for (size_t v = 1; v <= 1000; v++) {
+            el_histogram_record(&hist, v);
+        }
+        printf("count: %lu  total: %lu  max: %lu\n", hist.count, hist.total, hist.max);
+        printf("p0: %lu\n", el_histogram_percentile(&hist, 0));
+        printf("p50: %lu\n", el_histogram_percentile(&hist, 50));
+        printf("p90: %lu\n", el_histogram_percentile(&hist, 90));
+        printf("p99: %lu\n", el_histogram_percentile(&hist, 99));
+        printf("p100: %lu\n", el_histogram_percentile(&hist, 100));
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Constant Size Alloc") == 0) {
+        PRINT_TEST;
+        // Allocates and frees with constant sizes through the inline
+        // fast paths. Freed 32-byte blocks are parked in bin 4 and the
+        // next constant 32-byte allocations pop them back in reverse
+        // order. A size past the cache goes through el_malloc().
+
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = EL_MALLOC_CONST(32);
+        ptr[len++] = EL_MALLOC_CONST(32);
+        ptr[len++] = EL_MALLOC_CONST(400);
+        print_ptrs(ptr, len);
+        EL_FREE_CONST(ptr[0], 32);
+        EL_FREE_CONST(ptr[1], 32);
+        el_print_stats();
+
+        printf("\nREALLOCATE\n");
+        void *a = EL_MALLOC_CONST(32);
+        void *b = EL_MALLOC_CONST(32);
+        print_ptr("a", a);
+        print_ptr("b", b);
+        printf("cached blocks: %lu\n", el_ctl.cache_blocks);
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Quarantine") == 0) {
+        PRINT_TEST;
+        // Enables a 300 byte quarantine. Freed blocks are poisoned and
+        // held rather than returned to the available list. A write to
+        // the first block after it is freed is reported on stderr when
+        // the block is evicted to keep the quarantine within budget.
+        // Freeing a quarantined block again is a detected double free.
+
+        el_set_quarantine(300);
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(128);
+        ptr[len++] = el_malloc(64);
+        ptr[len++] = el_malloc(100);
+        el_free(ptr[0]);
+        el_free(ptr[1]);
+        el_print_stats();
+
+        printf("\nUSE AFTER FREE THEN EVICT\n");
+        ((char *) ptr[0])[5] = 'x';
+        el_free(ptr[2]);
+        el_free(ptr[2]);
+        el_print_stats();
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Aligned After Odd Size") == 0) {
+        PRINT_TEST;
+        // Allocates a block of an odd size before each aligned request so
+        // the next free byte is not 8-byte aligned. Every aligned pointer
+        // should still be a multiple of its alignment, and of 8 for
+        // smaller alignments, as should objects of a pool whose chunk
+        // follows an odd-sized block. The space taken to align a block
+        // should be given back, leaving little more than the 16 bytes
+        // asked for. Freeing everything should restore a single available
+        // block.
+
+        void *ptr[16] = {};
+        int len = 0;
+        size_t aligns[] = {1, 2, 4, 8, 16, 64};
+
+        for (int i = 0; i < 6; i++) {
+            ptr[len++] = el_malloc(3 + 2 * i);
+            void *aligned = el_aligned_alloc(aligns[i], 16);
+            ptr[len++] = aligned;
+            size_t need = aligns[i] < 8 ? 8 : aligns[i];
+            printf("alignment %2lu: %d  usable: %lu\n", aligns[i], (size_t) aligned % need == 0,
+                   el_malloc_usable_size(aligned));
+        }
+        for (int i = 0; i < len; i++) {
+            el_free(ptr[i]);
+        }
+
+        void *odd = el_malloc(5);
+        el_pool_t pool;
+        el_pool_init(&pool, 12, 4);
+        void *obj = el_pool_alloc(&pool);
+        printf("pool object: %d\n", (size_t) obj % 8 == 0);
+        el_pool_free(&pool, obj);
+        el_pool_destroy(&pool);
+        el_free(odd);
+
+        printf("\nFREE ALL\n");
+        el_print_stats();
+    } // ENDTEST
+
+    else if (strcmp(test_name, "Owner Died") == 0) {
+        PRINT_TEST;
+        // Child processes take the lock of a file-backed heap and die
+        // holding it. The first leaves the list links torn, which the
+        // parent should rebuild from the boundary tags. The second leaves
+        // a footer torn, after which the heap should refuse all requests.
+
+        el_cleanup();
+        unlink("test-owner-died.heap");
+        el_open("test-owner-died.heap");
+
+        void *ptr[16] = {};
+        int len = 0;
+
+        ptr[len++] = el_malloc(128);
+        ptr[len++] = el_malloc(200);
+        ptr[len++] = el_malloc(64);
+        el_free(ptr[1]);
+        fflush(stdout);
+
+        pid_t child = fork();
+        if (child == 0) {
+            pthread_mutex_lock(&el_ctl.file_header->lock);
+            el_blockhead_t *block = PTR_MINUS_BYTES(ptr[0], sizeof(el_blockhead_t));
+            block->next = block;
+            block->prev = NULL;
+            el_ctl.file_header->used.length = 99;
+            _exit(0);
+        }
+        waitpid(child, NULL, 0);
+
+        ptr[len++] = el_malloc(100);
+        printf("AFTER TORN LINKS\n");
+        el_print_stats();
+        printf("\n");
+        fflush(stdout);
+
+        child = fork();
+        if (child == 0) {
+            pthread_mutex_lock(&el_ctl.file_header->lock);
+            el_blockhead_t *block = PTR_MINUS_BYTES(ptr[2], sizeof(el_blockhead_t));
+            el_get_footer(block)->size = block->size + 8;
+            _exit(0);
+        }
+        waitpid(child, NULL, 0);
+
+        printf("AFTER TORN FOOTER\n");
+        printf("malloc: %p\n", el_malloc(16));
+        el_free(ptr[0]);
+        printf("sync: %d\n", el_sync());
+        el_print_stats();
+        unlink("test-owner-died.heap");
+    } // ENDTEST
+
     else {
         printf("No test named '%s' found\n",test_name);
         return 1;